@@ -0,0 +1,64 @@
+#ifndef _BOUNDS_H
+#define _BOUNDS_H
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "glm/glm.hpp"
+#include "vertex_format.h"
+
+// axis aligned bounding box with a bounding sphere around its center.
+// an empty box has min > max and zero radius.
+struct Bounds {
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  glm::vec3 center{0.0f};  // sphere center, at the center of the box
+  float radius = 0.0f;     // sphere radius
+
+  bool isEmpty() const { return min.x > max.x; }
+
+  glm::vec3 getExtent() const {
+    return isEmpty() ? glm::vec3(0.0f) : 0.5f * (max - min);
+  }
+
+  void merge(const Bounds& other) {
+    if (other.isEmpty()) return;
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+    center = 0.5f * (min + max);
+    radius = glm::length(max - center);
+  }
+
+  // bounds of given box, with the sphere around its corners
+  static Bounds fromBox(const glm::vec3& min, const glm::vec3& max) {
+    Bounds bounds;
+    bounds.min = min;
+    bounds.max = max;
+    bounds.center = 0.5f * (min + max);
+    bounds.radius = glm::length(max - bounds.center);
+    return bounds;
+  }
+
+  // bounds of given vertices. the sphere radius is the largest distance to
+  // the box center, which is tighter than half the box diagonal.
+  static Bounds compute(const Vertex* vertices, std::size_t nVertices) {
+    Bounds bounds;
+    for (std::size_t i = 0; i < nVertices; ++i) {
+      bounds.min = glm::min(bounds.min, vertices[i].position);
+      bounds.max = glm::max(bounds.max, vertices[i].position);
+    }
+    if (bounds.isEmpty()) return bounds;
+
+    bounds.center = 0.5f * (bounds.min + bounds.max);
+    float radius2 = 0.0f;
+    for (std::size_t i = 0; i < nVertices; ++i) {
+      const glm::vec3 d = vertices[i].position - bounds.center;
+      radius2 = std::max(radius2, glm::dot(d, d));
+    }
+    bounds.radius = std::sqrt(radius2);
+    return bounds;
+  }
+};
+
+#endif
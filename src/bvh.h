@@ -0,0 +1,430 @@
+#ifndef _BVH_H
+#define _BVH_H
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+#include "bounds.h"
+#include "frustum_culler.h"
+#include "glm/glm.hpp"
+#include "thread_pool.h"
+
+// bounding volume hierarchy over primitives given by their bounds, built
+// with binned SAH(Wald, "On fast Construction of SAH-based Bounding Volume
+// Hierarchies", 2007). subtrees above a size threshold are built in parallel
+// on the shared thread pool.
+//
+// primitives of a leaf are primitiveIndices[first, first + count); inner
+// nodes have count == 0 and their children at first and first + 1.
+class BVH {
+ public:
+  struct Node {
+    glm::vec3 min;
+    std::uint32_t first;
+    glm::vec3 max;
+    std::uint32_t count;
+
+    bool isLeaf() const { return count > 0; }
+  };
+
+  BVH() {}
+
+  // build over given primitive bounds. leaves hold at most maxLeafSize
+  // primitives and are split further while SAH says it pays off.
+  void build(const std::vector<Bounds>& primitives,
+             std::uint32_t maxLeafSize = 4) {
+    nodes.clear();
+    primitiveIndices.resize(primitives.size());
+    std::iota(primitiveIndices.begin(), primitiveIndices.end(), 0);
+    if (primitives.empty()) return;
+
+    // a binary tree with one primitive per leaf has 2n - 1 nodes
+    nodes.resize(2 * primitives.size() - 1);
+    std::atomic<std::uint32_t> nNodes{1};
+    this->maxLeafSize = std::max(maxLeafSize, 1u);
+    subdivide(primitives, nNodes, 0, 0, primitives.size());
+    nodes.resize(nNodes.load());
+    nodes.shrink_to_fit();
+
+    // links followed upwards by refit()
+    parents.assign(nodes.size(), 0);
+    primitiveLeaves.resize(primitives.size());
+    for (std::uint32_t i = 0; i < nodes.size(); ++i) {
+      const Node& node = nodes[i];
+      if (node.isLeaf()) {
+        for (std::uint32_t j = node.first; j < node.first + node.count; ++j) {
+          primitiveLeaves[primitiveIndices[j]] = i;
+        }
+      } else {
+        parents[node.first] = i;
+        parents[node.first + 1] = i;
+      }
+    }
+  }
+
+  // update boxes after the bounds of given primitives changed, keeping the
+  // tree. leaves of those primitives and their ancestors are recomputed,
+  // stopping where a box does not change. the tree is not rebalanced, so
+  // culling slows down when primitives move far.
+  void refit(const std::vector<Bounds>& primitives,
+             const std::vector<std::uint32_t>& changed) {
+    for (const std::uint32_t primitive : changed) {
+      std::uint32_t nodeIndex = primitiveLeaves[primitive];
+      while (true) {
+        Node& node = nodes[nodeIndex];
+        Box box;
+        if (node.isLeaf()) {
+          for (std::uint32_t i = node.first; i < node.first + node.count;
+               ++i) {
+            box.grow(primitives[primitiveIndices[i]]);
+          }
+        } else {
+          box.grow(Box{nodes[node.first].min, nodes[node.first].max});
+          box.grow(Box{nodes[node.first + 1].min, nodes[node.first + 1].max});
+        }
+        if (box.min.x > box.max.x) box.min = box.max = glm::vec3(0.0f);
+
+        if (box.min == node.min && box.max == node.max) break;
+        node.min = box.min;
+        node.max = box.max;
+        if (nodeIndex == 0) break;
+        nodeIndex = parents[nodeIndex];
+      }
+    }
+  }
+
+  bool empty() const { return nodes.empty(); }
+  std::size_t getNumNodes() const { return nodes.size(); }
+  const std::vector<Node>& getNodes() const { return nodes; }
+  const std::vector<std::uint32_t>& getPrimitiveIndices() const {
+    return primitiveIndices;
+  }
+
+  // visible[i] is set to 1 when primitive i intersects frustum. subtrees
+  // entirely inside a plane skip testing against it, and subtrees entirely
+  // inside the frustum are accepted without any test.
+  // returns number of visible primitives.
+  std::size_t cull(const Frustum& frustum, const std::vector<Bounds>& bounds,
+                   std::vector<unsigned char>& visible) const {
+    visible.assign(primitiveIndices.size(), 0);
+    if (nodes.empty()) return 0;
+
+    constexpr unsigned int ALL_PLANES = (1 << 6) - 1;
+    std::size_t nVisible = 0;
+    std::vector<std::pair<std::uint32_t, unsigned int>> stack;
+    stack.emplace_back(0, ALL_PLANES);
+    while (!stack.empty()) {
+      const auto [nodeIndex, parentMask] = stack.back();
+      stack.pop_back();
+      const Node& node = nodes[nodeIndex];
+
+      // planes the node still straddles
+      unsigned int mask = parentMask;
+      bool outside = false;
+      const glm::vec3 center = 0.5f * (node.min + node.max);
+      const glm::vec3 extent = 0.5f * (node.max - node.min);
+      for (int p = 0; p < 6 && mask; ++p) {
+        if (!(mask & (1 << p))) continue;
+        const glm::vec4& plane = frustum.planes[p];
+        const float d = glm::dot(glm::vec3(plane), center) + plane.w;
+        const float r = glm::dot(glm::abs(glm::vec3(plane)), extent);
+        if (d + r < 0.0f) {
+          outside = true;
+          break;
+        }
+        if (d - r >= 0.0f) mask &= ~(1 << p);
+      }
+      if (outside) continue;
+
+      if (node.isLeaf()) {
+        for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+          const std::uint32_t primitive = primitiveIndices[i];
+          if (mask == 0 || frustum.intersects(bounds[primitive])) {
+            visible[primitive] = 1;
+            nVisible++;
+          }
+        }
+      } else {
+        stack.emplace_back(node.first, mask);
+        stack.emplace_back(node.first + 1, mask);
+      }
+    }
+    return nVisible;
+  }
+
+  // find closest primitive hit by ray origin + t * direction, t in
+  // [0, tMax). intersectPrimitive(primitive, tMax) tests a single primitive
+  // and lowers tMax on a closer hit, returning whether it did.
+  // returns the index of the closest primitive hit.
+  template <typename F>
+  std::optional<std::uint32_t> intersect(const glm::vec3& origin,
+                                         const glm::vec3& direction,
+                                         float& tMax,
+                                         F&& intersectPrimitive) const {
+    std::optional<std::uint32_t> hit;
+    if (nodes.empty()) return hit;
+
+    const glm::vec3 invDirection = 1.0f / direction;
+    std::vector<std::uint32_t> stack;
+    stack.push_back(0);
+    while (!stack.empty()) {
+      const Node& node = nodes[stack.back()];
+      stack.pop_back();
+      if (!intersectBox(node, origin, invDirection, tMax)) continue;
+
+      if (node.isLeaf()) {
+        for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+          if (intersectPrimitive(primitiveIndices[i], tMax)) {
+            hit = primitiveIndices[i];
+          }
+        }
+        continue;
+      }
+
+      // visit nearer child first
+      const Node& left = nodes[node.first];
+      const Node& right = nodes[node.first + 1];
+      const std::optional<float> tLeft =
+          intersectBox(left, origin, invDirection, tMax);
+      const std::optional<float> tRight =
+          intersectBox(right, origin, invDirection, tMax);
+      if (tLeft && tRight) {
+        const bool leftFirst = tLeft.value() <= tRight.value();
+        stack.push_back(leftFirst ? node.first + 1 : node.first);
+        stack.push_back(leftFirst ? node.first : node.first + 1);
+      } else if (tLeft) {
+        stack.push_back(node.first);
+      } else if (tRight) {
+        stack.push_back(node.first + 1);
+      }
+    }
+    return hit;
+  }
+
+  // entry distance of ray into node box, if it enters before tMax
+  static std::optional<float> intersectBox(const Node& node,
+                                           const glm::vec3& origin,
+                                           const glm::vec3& invDirection,
+                                           float tMax) {
+    const glm::vec3 t0 = (node.min - origin) * invDirection;
+    const glm::vec3 t1 = (node.max - origin) * invDirection;
+    const glm::vec3 tNear = glm::min(t0, t1);
+    const glm::vec3 tFar = glm::max(t0, t1);
+    const float tEnter = std::max(std::max(tNear.x, tNear.y),
+                                  std::max(tNear.z, 0.0f));
+    const float tExit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+    if (tEnter > tExit || tEnter >= tMax) return std::nullopt;
+    return tEnter;
+  }
+
+  // ray-triangle intersection(Moller and Trumbore 1997). returns distance
+  // along the ray.
+  static std::optional<float> intersectTriangle(const glm::vec3& origin,
+                                                const glm::vec3& direction,
+                                                const glm::vec3& p0,
+                                                const glm::vec3& p1,
+                                                const glm::vec3& p2) {
+    const glm::vec3 e1 = p1 - p0;
+    const glm::vec3 e2 = p2 - p0;
+    const glm::vec3 p = glm::cross(direction, e2);
+    const float det = glm::dot(e1, p);
+    if (std::abs(det) < 1e-12f) return std::nullopt;
+
+    const float invDet = 1.0f / det;
+    const glm::vec3 s = origin - p0;
+    const float u = invDet * glm::dot(s, p);
+    if (u < 0.0f || u > 1.0f) return std::nullopt;
+    const glm::vec3 q = glm::cross(s, e1);
+    const float v = invDet * glm::dot(direction, q);
+    if (v < 0.0f || u + v > 1.0f) return std::nullopt;
+
+    const float t = invDet * glm::dot(e2, q);
+    if (t < 0.0f) return std::nullopt;
+    return t;
+  }
+
+ private:
+  static constexpr int N_BINS = 16;
+  // subtrees with more primitives than this are built on worker threads
+  static constexpr std::size_t PARALLEL_THRESHOLD = 4096;
+  // cost of traversing a node relative to intersecting a primitive
+  static constexpr float TRAVERSAL_COST = 1.0f;
+
+  std::vector<Node> nodes;
+  std::vector<std::uint32_t> primitiveIndices;
+  std::vector<std::uint32_t> parents;          // per node, 0 for the root
+  std::vector<std::uint32_t> primitiveLeaves;  // leaf of each primitive
+  std::uint32_t maxLeafSize = 4;
+
+  // plain box, cheaper to grow than Bounds which also tracks a sphere
+  struct Box {
+    glm::vec3 min{std::numeric_limits<float>::max()};
+    glm::vec3 max{std::numeric_limits<float>::lowest()};
+
+    void grow(const Box& box) {
+      min = glm::min(min, box.min);
+      max = glm::max(max, box.max);
+    }
+    void grow(const Bounds& bounds) {
+      if (bounds.isEmpty()) return;
+      min = glm::min(min, bounds.min);
+      max = glm::max(max, bounds.max);
+    }
+
+    float surfaceArea() const {
+      if (min.x > max.x) return 0.0f;
+      const glm::vec3 d = max - min;
+      return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+  };
+
+  struct Bin {
+    Box box;
+    std::uint32_t count = 0;
+  };
+
+  void makeLeaf(Node& node, std::size_t first, std::size_t count) {
+    node.first = first;
+    node.count = count;
+  }
+
+  // nNodes counts nodes allocated so far, shared by all build threads
+  void subdivide(const std::vector<Bounds>& primitives,
+                 std::atomic<std::uint32_t>& nNodes, std::uint32_t nodeIndex,
+                 std::size_t first, std::size_t count) {
+    Node& node = nodes[nodeIndex];
+
+    // node bounds and bounds of primitive centers
+    Box nodeBox;
+    glm::vec3 centerMin(std::numeric_limits<float>::max());
+    glm::vec3 centerMax(std::numeric_limits<float>::lowest());
+    for (std::size_t i = first; i < first + count; ++i) {
+      const Bounds& bounds = primitives[primitiveIndices[i]];
+      nodeBox.grow(bounds);
+      centerMin = glm::min(centerMin, bounds.center);
+      centerMax = glm::max(centerMax, bounds.center);
+    }
+    if (nodeBox.min.x > nodeBox.max.x) {
+      nodeBox.min = nodeBox.max = glm::vec3(0.0f);
+    }
+    node.min = nodeBox.min;
+    node.max = nodeBox.max;
+
+    if (count <= 1) {
+      makeLeaf(node, first, count);
+      return;
+    }
+
+    // find cheapest split among bin boundaries of every axis
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    int bestSplit = 0;
+    const glm::vec3 centerExtent = centerMax - centerMin;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (centerExtent[axis] <= 0.0f) continue;
+      const float scale = N_BINS / centerExtent[axis];
+
+      Bin bins[N_BINS];
+      for (std::size_t i = first; i < first + count; ++i) {
+        const Bounds& bounds = primitives[primitiveIndices[i]];
+        const int b = std::min(
+            N_BINS - 1,
+            static_cast<int>((bounds.center[axis] - centerMin[axis]) * scale));
+        bins[b].box.grow(bounds);
+        bins[b].count++;
+      }
+
+      // sweep from the right, then from the left
+      float rightArea[N_BINS - 1];
+      std::uint32_t rightCount[N_BINS - 1];
+      Box right;
+      std::uint32_t nRight = 0;
+      for (int b = N_BINS - 1; b > 0; --b) {
+        right.grow(bins[b].box);
+        nRight += bins[b].count;
+        rightArea[b - 1] = right.surfaceArea();
+        rightCount[b - 1] = nRight;
+      }
+      Box left;
+      std::uint32_t nLeft = 0;
+      for (int b = 0; b < N_BINS - 1; ++b) {
+        left.grow(bins[b].box);
+        nLeft += bins[b].count;
+        if (nLeft == 0 || rightCount[b] == 0) continue;
+        const float cost =
+            nLeft * left.surfaceArea() + rightCount[b] * rightArea[b];
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = axis;
+          bestSplit = b;
+        }
+      }
+    }
+
+    // SAH cost of splitting against intersecting every primitive
+    const float parentArea = nodeBox.surfaceArea();
+    const float splitCost =
+        parentArea > 0.0f ? TRAVERSAL_COST + bestCost / parentArea
+                          : std::numeric_limits<float>::max();
+    if (count <= maxLeafSize && splitCost >= count) {
+      makeLeaf(node, first, count);
+      return;
+    }
+
+    // partition primitives, falling back to a median split when all
+    // centers share one bin
+    std::size_t middle = first;
+    if (bestAxis >= 0) {
+      const float scale = N_BINS / centerExtent[bestAxis];
+      middle = std::partition(
+                   primitiveIndices.begin() + first,
+                   primitiveIndices.begin() + first + count,
+                   [&](std::uint32_t primitive) {
+                     const int b = std::min(
+                         N_BINS - 1,
+                         static_cast<int>((primitives[primitive]
+                                               .center[bestAxis] -
+                                           centerMin[bestAxis]) *
+                                          scale));
+                     return b <= bestSplit;
+                   }) -
+               primitiveIndices.begin();
+    }
+    if (middle == first || middle == first + count) {
+      middle = first + count / 2;
+      std::nth_element(primitiveIndices.begin() + first,
+                       primitiveIndices.begin() + middle,
+                       primitiveIndices.begin() + first + count,
+                       [&](std::uint32_t a, std::uint32_t b) {
+                         return primitives[a].center.x <
+                                primitives[b].center.x;
+                       });
+    }
+
+    const std::uint32_t leftIndex = nNodes.fetch_add(2);
+    node.first = leftIndex;
+    node.count = 0;
+
+    const std::size_t leftCount = middle - first;
+    const std::size_t rightCount = count - leftCount;
+    if (count > PARALLEL_THRESHOLD) {
+      ThreadPool::shared().parallelFor(2, [&](std::size_t child) {
+        if (child == 0) {
+          subdivide(primitives, nNodes, leftIndex, first, leftCount);
+        } else {
+          subdivide(primitives, nNodes, leftIndex + 1, middle, rightCount);
+        }
+      });
+    } else {
+      subdivide(primitives, nNodes, leftIndex, first, leftCount);
+      subdivide(primitives, nNodes, leftIndex + 1, middle, rightCount);
+    }
+  }
+};
+
+#endif
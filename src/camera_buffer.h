@@ -0,0 +1,133 @@
+#ifndef _CAMERA_BUFFER_H
+#define _CAMERA_BUFFER_H
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+
+// std140 layout of CameraBlock. two mat4 need no padding.
+struct CameraBlock {
+  glm::mat4 view;
+  glm::mat4 projection;
+};
+
+// uniform buffer of CameraBlock, bound to a binding point.
+//
+// with GL_ARB_buffer_storage, the buffer is a persistently mapped ring of
+// N_SLOTS blocks. each update writes the next slot and rebinds the range,
+// and a fence placed at the end of every frame guards the slot in use, so
+// an update only waits when the GPU is N_SLOTS frames behind. otherwise the
+// block is written in place with glBufferSubData, which unlike
+// glBufferData does not reallocate storage.
+class CameraBuffer {
+ public:
+  explicit CameraBuffer(GLuint binding) : binding(binding) {}
+
+  void create() {
+    glGenBuffers(1, &UBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    if (GLAD_GL_ARB_buffer_storage) {
+      GLint alignment = 1;
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+      slotStride =
+          (sizeof(CameraBlock) + alignment - 1) / alignment * alignment;
+
+      const GLbitfield flags =
+          GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+      glBufferStorage(GL_UNIFORM_BUFFER, N_SLOTS * slotStride, nullptr,
+                      flags);
+      mapped = static_cast<unsigned char*>(glMapBufferRange(
+          GL_UNIFORM_BUFFER, 0, N_SLOTS * slotStride, flags));
+    }
+    if (!mapped) {
+      slotStride = sizeof(CameraBlock);
+      glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), nullptr,
+                   GL_DYNAMIC_DRAW);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+
+  // write block for the following draws
+  void update(const CameraBlock& block) {
+    const auto updateStart = std::chrono::steady_clock::now();
+    if (mapped) {
+      current = (current + 1) % N_SLOTS;
+      waitSlot(current);
+      std::memcpy(mapped + current * slotStride, &block, sizeof(CameraBlock));
+      glBindBufferRange(GL_UNIFORM_BUFFER, binding, UBO,
+                        current * slotStride, sizeof(CameraBlock));
+    } else {
+      glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+      glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &block);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+      glBindBufferBase(GL_UNIFORM_BUFFER, binding, UBO);
+    }
+    updateTime += std::chrono::duration<float, std::milli>(
+                      std::chrono::steady_clock::now() - updateStart)
+                      .count();
+    nUpdates++;
+  }
+
+  // guard the slot read by this frame. call after its draws.
+  void endFrame() {
+    if (!mapped) return;
+    if (fences[current]) glDeleteSync(fences[current]);
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+
+  bool isPersistent() const { return mapped != nullptr; }
+
+  // updates and CPU time spent in them, in milliseconds, since the last
+  // resetStatistics()
+  std::size_t getNumUpdates() const { return nUpdates; }
+  float getUpdateTime() const { return updateTime; }
+  void resetStatistics() {
+    nUpdates = 0;
+    updateTime = 0.0f;
+  }
+
+  void destroy() {
+    for (auto& fence : fences) {
+      if (fence) glDeleteSync(fence);
+      fence = nullptr;
+    }
+    if (mapped) {
+      glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+      glUnmapBuffer(GL_UNIFORM_BUFFER);
+      glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    if (UBO) glDeleteBuffers(1, &UBO);
+    UBO = 0;
+    mapped = nullptr;
+  }
+
+ private:
+  static constexpr std::size_t N_SLOTS = 3;
+
+  GLuint binding;
+  GLuint UBO = 0;
+  unsigned char* mapped = nullptr;
+  std::size_t slotStride = 0;
+  std::size_t current = 0;
+  std::array<GLsync, N_SLOTS> fences{};
+  std::size_t nUpdates = 0;
+  float updateTime = 0.0f;
+
+  // wait until the GPU has finished the frames reading given slot
+  void waitSlot(std::size_t slot) {
+    GLsync& fence = fences[slot];
+    if (!fence) return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+};
+
+#endif
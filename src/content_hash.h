@@ -0,0 +1,97 @@
+#ifndef _CONTENT_HASH_H
+#define _CONTENT_HASH_H
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// fast non-cryptographic 64-bit hash of byte strings, following XXH64. it
+// hashes 32 bytes per step in four independent lanes. equal hashes only
+// suggest equal content, so matches must be confirmed by comparing the data.
+class ContentHash {
+ public:
+  // hash of given bytes. chain several buffers by passing the hash of the
+  // previous one as seed.
+  static std::uint64_t hash(const void* data, std::size_t size,
+                            std::uint64_t seed = 0) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + size;
+    std::uint64_t h;
+
+    if (size >= 32) {
+      std::uint64_t v1 = seed + PRIME1 + PRIME2;
+      std::uint64_t v2 = seed + PRIME2;
+      std::uint64_t v3 = seed;
+      std::uint64_t v4 = seed - PRIME1;
+      const unsigned char* const limit = end - 32;
+      do {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+      } while (p <= limit);
+
+      h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+      h = mergeRound(h, v1);
+      h = mergeRound(h, v2);
+      h = mergeRound(h, v3);
+      h = mergeRound(h, v4);
+    } else {
+      h = seed + PRIME5;
+    }
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+      h ^= round(0, read64(p));
+      h = rotl(h, 27) * PRIME1 + PRIME4;
+    }
+    if (p + 4 <= end) {
+      h ^= read32(p) * PRIME1;
+      h = rotl(h, 23) * PRIME2 + PRIME3;
+      p += 4;
+    }
+    for (; p < end; ++p) {
+      h ^= *p * PRIME5;
+      h = rotl(h, 11) * PRIME1;
+    }
+
+    // avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+  }
+
+ private:
+  static constexpr std::uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+  static constexpr std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+  static constexpr std::uint64_t PRIME3 = 0x165667B19E3779F9ull;
+  static constexpr std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+  static constexpr std::uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+  static std::uint64_t rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+  }
+  static std::uint64_t read64(const unsigned char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static std::uint64_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+  static std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+  }
+  static std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t value) {
+    acc ^= round(0, value);
+    return acc * PRIME1 + PRIME4;
+  }
+};
+
+#endif
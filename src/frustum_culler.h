@@ -0,0 +1,162 @@
+#ifndef _FRUSTUM_CULLER_H
+#define _FRUSTUM_CULLER_H
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+
+// six planes of a view frustum, normals pointing inside
+struct Frustum {
+  glm::vec4 planes[6];
+
+  // extract planes from a view projection matrix(Gribb and Hartmann 2001)
+  static Frustum fromMatrix(const glm::mat4& viewProjection) {
+    const glm::mat4 m = glm::transpose(viewProjection);
+    Frustum frustum;
+    frustum.planes[0] = m[3] + m[0];  // left
+    frustum.planes[1] = m[3] - m[0];  // right
+    frustum.planes[2] = m[3] + m[1];  // bottom
+    frustum.planes[3] = m[3] - m[1];  // top
+    frustum.planes[4] = m[3] + m[2];  // near
+    frustum.planes[5] = m[3] - m[2];  // far
+    for (auto& plane : frustum.planes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+  }
+
+  // true unless given bounds are completely outside of a plane
+  bool intersects(const Bounds& bounds) const {
+    const glm::vec3 extent = bounds.getExtent();
+    for (const auto& plane : planes) {
+      const glm::vec3 n(plane);
+      const float d = glm::dot(n, bounds.center) + plane.w;
+      const float r = std::min(glm::dot(glm::abs(n), extent), bounds.radius);
+      if (d + r < 0.0f) return false;
+    }
+    return true;
+  }
+};
+
+// tests many bounds against a frustum at once. bounds are kept as structure
+// of arrays, so that four of them are tested per SSE instruction.
+//
+// a mesh is culled when its box or its sphere lies outside of a plane; the
+// sphere is centered on the box, so the smaller of both radii along the plane
+// normal is used.
+class FrustumCuller {
+ public:
+  void setBounds(const std::vector<Bounds>& bounds) {
+    nBounds = bounds.size();
+    const std::size_t n = (nBounds + LANES - 1) / LANES * LANES;
+    for (auto* array : {&centerX, &centerY, &centerZ, &extentX, &extentY,
+                        &extentZ, &radius}) {
+      array->assign(n, 0.0f);
+    }
+
+    for (std::size_t i = 0; i < nBounds; ++i) {
+      updateBounds(i, bounds[i]);
+    }
+  }
+
+  // replace bounds i of those given to setBounds()
+  void updateBounds(std::size_t i, const Bounds& bounds) {
+    const glm::vec3 extent = bounds.getExtent();
+    centerX[i] = bounds.center.x;
+    centerY[i] = bounds.center.y;
+    centerZ[i] = bounds.center.z;
+    extentX[i] = extent.x;
+    extentY[i] = extent.y;
+    extentZ[i] = extent.z;
+    radius[i] = bounds.radius;
+  }
+
+  // visible[i] is set to 1 when bounds i intersect frustum, 0 otherwise.
+  // returns number of visible bounds.
+  std::size_t cull(const Frustum& frustum,
+                   std::vector<unsigned char>& visible) const {
+    visible.resize(nBounds);
+    std::size_t nVisible = 0;
+
+#ifdef FRUSTUM_CULLER_SSE2
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    for (std::size_t i = 0; i < nBounds; i += LANES) {
+      const __m128 cx = _mm_loadu_ps(&centerX[i]);
+      const __m128 cy = _mm_loadu_ps(&centerY[i]);
+      const __m128 cz = _mm_loadu_ps(&centerZ[i]);
+      const __m128 ex = _mm_loadu_ps(&extentX[i]);
+      const __m128 ey = _mm_loadu_ps(&extentY[i]);
+      const __m128 ez = _mm_loadu_ps(&extentZ[i]);
+      const __m128 r = _mm_loadu_ps(&radius[i]);
+
+      // lanes outside of any plane
+      __m128 outside = _mm_setzero_ps();
+      for (const auto& plane : frustum.planes) {
+        const __m128 nx = _mm_set1_ps(plane.x);
+        const __m128 ny = _mm_set1_ps(plane.y);
+        const __m128 nz = _mm_set1_ps(plane.z);
+        const __m128 d = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+            _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w)));
+        const __m128 boxRadius = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                       _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+            _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+        const __m128 distance = _mm_add_ps(d, _mm_min_ps(boxRadius, r));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, zero));
+      }
+
+      const int mask = _mm_movemask_ps(outside);
+      const std::size_t end = std::min(i + LANES, nBounds);
+      for (std::size_t j = i; j < end; ++j) {
+        visible[j] = !(mask & (1 << (j - i)));
+        nVisible += visible[j];
+      }
+    }
+#else
+    for (std::size_t i = 0; i < nBounds; ++i) {
+      bool outside = false;
+      for (const auto& plane : frustum.planes) {
+        const float d = plane.x * centerX[i] + plane.y * centerY[i] +
+                        plane.z * centerZ[i] + plane.w;
+        const float boxRadius = std::abs(plane.x) * extentX[i] +
+                                std::abs(plane.y) * extentY[i] +
+                                std::abs(plane.z) * extentZ[i];
+        outside |= d + std::min(boxRadius, radius[i]) < 0.0f;
+      }
+      visible[i] = !outside;
+      nVisible += visible[i];
+    }
+#endif
+
+    return nVisible;
+  }
+
+  std::size_t size() const { return nBounds; }
+
+ private:
+  static constexpr std::size_t LANES = 4;
+
+  std::size_t nBounds = 0;
+
+  // padded to a multiple of LANES
+  std::vector<float> centerX;
+  std::vector<float> centerY;
+  std::vector<float> centerZ;
+  std::vector<float> extentX;
+  std::vector<float> extentY;
+  std::vector<float> extentZ;
+  std::vector<float> radius;
+};
+
+#endif
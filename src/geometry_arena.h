@@ -0,0 +1,201 @@
+#ifndef _GEOMETRY_ARENA_H
+#define _GEOMETRY_ARENA_H
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+
+#include "glad/glad.h"
+#include "memory_usage.h"
+#include "offset_allocator.h"
+#include "vertex_format.h"
+
+// vertex and index buffers shared by every mesh, so that a whole model is
+// drawn from one VAO per vertex format with glDrawElementsBaseVertex.
+// ranges are sub-allocated with OffsetAllocator and can be freed one by one,
+// so models are unloaded and reloaded without recreating the buffers.
+// buffers grow by doubling, copying their contents on the GPU.
+class GeometryArena {
+ public:
+  // storage of a mesh in the arena
+  struct Range {
+    VertexFormat format = VertexFormat::Float;
+    OffsetAllocator::Allocation vertices;
+    OffsetAllocator::Allocation indices;
+    GLint baseVertex = 0;
+    std::size_t indexOffset = 0;  // in bytes
+  };
+
+  GeometryArena(std::uint32_t initialVertices = 1 << 20,
+                std::size_t initialIndexBytes = 16 << 20)
+      : initialVertices(initialVertices),
+        initialIndexUnits((initialIndexBytes + INDEX_UNIT - 1) / INDEX_UNIT) {}
+
+  // copy vertices packed in given format and indices(16 or 32 bit) into
+  // the arena
+  Range allocate(VertexFormat format, const void* vertexData,
+                 std::size_t nVertices, const void* indexData,
+                 std::size_t indexBytes) {
+    Pool& pool = pools[static_cast<int>(format)];
+    const std::size_t stride = VertexPacker::getVertexSize(format);
+
+    Range range;
+    range.format = format;
+
+    // vertices
+    std::optional<OffsetAllocator::Allocation> vertices =
+        pool.allocator.allocate(nVertices);
+    while (!vertices) {
+      const std::uint32_t size = pool.allocator.getSize();
+      growVertexBuffer(format,
+                       std::max<std::uint32_t>(
+                           size > 0 ? 2 * size : initialVertices,
+                           size + nVertices));
+      vertices = pool.allocator.allocate(nVertices);
+    }
+    range.vertices = vertices.value();
+    range.baseVertex = range.vertices.offset;
+    if (nVertices > 0) {
+      glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+      glBufferSubData(GL_ARRAY_BUFFER, range.vertices.offset * stride,
+                      nVertices * stride, vertexData);
+      glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // indices, aligned to INDEX_UNIT
+    const std::uint32_t indexUnits = (indexBytes + INDEX_UNIT - 1) / INDEX_UNIT;
+    std::optional<OffsetAllocator::Allocation> indices =
+        indexAllocator.allocate(indexUnits);
+    while (!indices) {
+      const std::uint32_t size = indexAllocator.getSize();
+      growIndexBuffer(std::max<std::uint32_t>(
+          size > 0 ? 2 * size : initialIndexUnits, size + indexUnits));
+      indices = indexAllocator.allocate(indexUnits);
+    }
+    range.indices = indices.value();
+    range.indexOffset =
+        static_cast<std::size_t>(range.indices.offset) * INDEX_UNIT;
+    if (indexBytes > 0) {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, indexBytes,
+                      indexData);
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    return range;
+  }
+
+  void free(const Range& range) {
+    pools[static_cast<int>(range.format)].allocator.free(range.vertices);
+    indexAllocator.free(range.indices);
+  }
+
+  // bind VAO of given vertex format. does nothing before the first
+  // allocation of that format.
+  void bind(VertexFormat format) const {
+    glBindVertexArray(pools[static_cast<int>(format)].VAO);
+  }
+
+  void printStatistics() const {
+    for (int i = 0; i < N_FORMATS; ++i) {
+      const Pool& pool = pools[i];
+      if (!pool.VAO) continue;
+      const VertexFormat format = static_cast<VertexFormat>(i);
+      const std::size_t stride = VertexPacker::getVertexSize(format);
+      const std::size_t used = pool.allocator.getUsedSize() * stride;
+      const std::size_t size = pool.allocator.getSize() * stride;
+      std::cout << "[GeometryArena] " << VertexPacker::getName(format)
+                << " vertices: " << MemoryUsage::toMegabytes(used)
+                << " MB of " << MemoryUsage::toMegabytes(size) << " MB"
+                << std::endl;
+    }
+    const std::size_t used =
+        static_cast<std::size_t>(indexAllocator.getUsedSize()) * INDEX_UNIT;
+    const std::size_t size =
+        static_cast<std::size_t>(indexAllocator.getSize()) * INDEX_UNIT;
+    std::cout << "[GeometryArena] indices: " << MemoryUsage::toMegabytes(used)
+              << " MB of " << MemoryUsage::toMegabytes(size) << " MB"
+              << std::endl;
+  }
+
+  void destroy() {
+    for (auto& pool : pools) {
+      if (pool.VAO) glDeleteVertexArrays(1, &pool.VAO);
+      if (pool.VBO) glDeleteBuffers(1, &pool.VBO);
+      pool.VAO = 0;
+      pool.VBO = 0;
+      pool.allocator.reset(0);
+    }
+    if (EBO) glDeleteBuffers(1, &EBO);
+    EBO = 0;
+    indexAllocator.reset(0);
+  }
+
+ private:
+  // index ranges start at multiples of 4 bytes, so that both 16 and 32 bit
+  // indices are aligned
+  static constexpr std::size_t INDEX_UNIT = 4;
+  static constexpr int N_FORMATS = 3;
+
+  struct Pool {
+    GLuint VAO = 0;
+    GLuint VBO = 0;
+    OffsetAllocator allocator;  // in vertices
+  };
+
+  std::uint32_t initialVertices;
+  std::uint32_t initialIndexUnits;
+  Pool pools[N_FORMATS];
+  GLuint EBO = 0;
+  OffsetAllocator indexAllocator;  // in INDEX_UNIT
+
+  // replace buffer by a larger one holding the same data
+  static GLuint resizeBuffer(GLuint buffer, std::size_t oldSize,
+                             std::size_t newSize) {
+    GLuint newBuffer;
+    glGenBuffers(1, &newBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+    if (buffer) {
+      glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                          oldSize);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glDeleteBuffers(1, &buffer);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return newBuffer;
+  }
+
+  void growVertexBuffer(VertexFormat format, std::uint32_t nVertices) {
+    Pool& pool = pools[static_cast<int>(format)];
+    const std::size_t stride = VertexPacker::getVertexSize(format);
+    pool.VBO = resizeBuffer(pool.VBO, pool.allocator.getSize() * stride,
+                            nVertices * stride);
+    pool.allocator.grow(nVertices);
+
+    if (!pool.VAO) glGenVertexArrays(1, &pool.VAO);
+    glBindVertexArray(pool.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, pool.VBO);
+    VertexPacker::setupAttributes(format);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  void growIndexBuffer(std::uint32_t nUnits) {
+    EBO = resizeBuffer(EBO, indexAllocator.getSize() * INDEX_UNIT,
+                       nUnits * INDEX_UNIT);
+    indexAllocator.grow(nUnits);
+
+    // element array binding is part of VAO state
+    for (const auto& pool : pools) {
+      if (!pool.VAO) continue;
+      glBindVertexArray(pool.VAO);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    }
+    glBindVertexArray(0);
+  }
+};
+
+#endif
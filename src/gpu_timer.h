@@ -0,0 +1,64 @@
+#ifndef _GPU_TIMER_H
+#define _GPU_TIMER_H
+#include <array>
+
+#include "glad/glad.h"
+
+// measures GPU time of the commands between begin() and end() with
+// GL_TIME_ELAPSED queries. results are read a few frames later when they
+// are available, so measuring never stalls the pipeline.
+class GpuTimer {
+ public:
+  void begin() {
+    if (!queries[0]) glGenQueries(N_QUERIES, queries.data());
+
+    // skip frame while the query of this slot is still in flight
+    if (pending[current]) {
+      if (!collect(current)) return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    active = true;
+  }
+
+  void end() {
+    if (!active) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[current] = true;
+    active = false;
+    current = (current + 1) % N_QUERIES;
+  }
+
+  // exponential average of measured times in milliseconds
+  float getTime() const { return time; }
+
+  void destroy() {
+    if (queries[0]) glDeleteQueries(N_QUERIES, queries.data());
+    queries.fill(0);
+    pending.fill(false);
+  }
+
+ private:
+  static constexpr int N_QUERIES = 4;
+
+  std::array<GLuint, N_QUERIES> queries{};
+  std::array<bool, N_QUERIES> pending{};
+  int current = 0;
+  bool active = false;
+  float time = 0.0f;
+
+  // read result of given query if available
+  bool collect(int index) {
+    GLint available = 0;
+    glGetQueryObjectiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &elapsed);
+    const float ms = elapsed * 1e-6f;
+    time = time > 0.0f ? 0.95f * time + 0.05f * ms : ms;
+    pending[index] = false;
+    return true;
+  }
+};
+
+#endif
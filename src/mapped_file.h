@@ -0,0 +1,104 @@
+#ifndef _MAPPED_FILE_H
+#define _MAPPED_FILE_H
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only memory mapping of a whole file
+class MappedFile {
+ public:
+  MappedFile() {}
+  MappedFile(const std::string& filepath) { open(filepath); }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { close(); }
+
+  operator bool() const { return mapped != nullptr; }
+
+  const unsigned char* data() const {
+    return static_cast<const unsigned char*>(mapped);
+  }
+  std::size_t size() const { return fileSize; }
+
+  bool open(const std::string& filepath) {
+    close();
+
+#ifdef _WIN32
+    file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                       nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN,
+                       nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+      close();
+      return false;
+    }
+    fileSize = static_cast<std::size_t>(size.QuadPart);
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+      close();
+      return false;
+    }
+    mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    const int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+    }
+    fileSize = static_cast<std::size_t>(st.st_size);
+
+    void* ptr = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    mapped = ptr == MAP_FAILED ? nullptr : ptr;
+#endif
+
+    if (!mapped) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (mapped) UnmapViewOfFile(mapped);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    mapping = nullptr;
+    file = INVALID_HANDLE_VALUE;
+#else
+    if (mapped) munmap(mapped, fileSize);
+#endif
+    mapped = nullptr;
+    fileSize = 0;
+  }
+
+ private:
+  void* mapped = nullptr;
+  std::size_t fileSize = 0;
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#endif
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef _MATERIAL_BUFFER_H
+#define _MATERIAL_BUFFER_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "shader.h"
+
+// std140 layout of a material in MaterialBlock
+struct MaterialBlockEntry {
+  glm::vec4 kd;  // w: shininess
+  glm::vec4 ks;  // w: layer of diffuse texture, -1 if none
+  glm::vec4 ka;  // w: layer of specular texture, -1 if none
+};
+
+// every material of a model in one uniform buffer. a uniform block holds
+// at most WINDOW_SIZE materials, so the buffer is split into windows which
+// are bound with glBindBufferRange, and draws select their material by its
+// index inside the bound window.
+class MaterialBuffer {
+ public:
+  // binding point of MaterialBlock. CameraBlock uses 0.
+  static constexpr GLuint BINDING = 1;
+  // materials per window, matches the array size of MaterialBlock
+  static constexpr std::size_t WINDOW_SIZE = 256;
+
+  static void setupShader(const Shader& shader) {
+    shader.setUBO("MaterialBlock", BINDING);
+  }
+
+  static std::size_t getWindow(std::uint32_t materialIndex) {
+    return materialIndex / WINDOW_SIZE;
+  }
+  static GLuint getIndexInWindow(std::uint32_t materialIndex) {
+    return materialIndex % WINDOW_SIZE;
+  }
+
+  void setMaterials(const std::vector<MaterialBlockEntry>& materials) {
+    if (!UBO) glGenBuffers(1, &UBO);
+
+    // windows start at multiples of the offset alignment and are padded to
+    // the full block size
+    GLint alignment = 1;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    const std::size_t windowBytes = WINDOW_SIZE * sizeof(MaterialBlockEntry);
+    windowStride =
+        (windowBytes + alignment - 1) / alignment * alignment;
+    nWindows = std::max<std::size_t>(
+        (materials.size() + WINDOW_SIZE - 1) / WINDOW_SIZE, 1);
+
+    std::vector<unsigned char> data(nWindows * windowStride, 0);
+    for (std::size_t i = 0; i < materials.size(); ++i) {
+      std::copy_n(reinterpret_cast<const unsigned char*>(&materials[i]),
+                  sizeof(MaterialBlockEntry),
+                  data.data() + getWindow(i) * windowStride +
+                      getIndexInWindow(i) * sizeof(MaterialBlockEntry));
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+    glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    boundWindow = NO_WINDOW;
+  }
+
+  // bind given window to BINDING, unless it is already bound
+  void bindWindow(std::size_t window) {
+    if (window == boundWindow || window >= nWindows) return;
+    glBindBufferRange(GL_UNIFORM_BUFFER, BINDING, UBO, window * windowStride,
+                      WINDOW_SIZE * sizeof(MaterialBlockEntry));
+    boundWindow = window;
+  }
+
+  // forget the bound window, e.g. when another model used BINDING
+  void invalidateBinding() { boundWindow = NO_WINDOW; }
+
+  std::size_t getNumWindows() const { return nWindows; }
+
+  void destroy() {
+    if (UBO) glDeleteBuffers(1, &UBO);
+    UBO = 0;
+    nWindows = 0;
+    boundWindow = NO_WINDOW;
+  }
+
+ private:
+  static constexpr std::size_t NO_WINDOW = ~std::size_t(0);
+
+  GLuint UBO = 0;
+  std::size_t windowStride = 0;
+  std::size_t nWindows = 0;
+  std::size_t boundWindow = NO_WINDOW;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef _MEMORY_USAGE_H
+#define _MEMORY_USAGE_H
+#include <cstddef>
+
+#if defined(__linux__)
+#include <fstream>
+#include <string>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/resource.h>
+#endif
+
+// resident set size of this process, in bytes. returns 0 on unsupported
+// platforms.
+struct MemoryUsage {
+  std::size_t rss = 0;
+  std::size_t peakRSS = 0;
+
+  static MemoryUsage get() {
+    MemoryUsage usage;
+#if defined(__linux__)
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+      // values are given in kB
+      if (line.compare(0, 6, "VmRSS:") == 0) {
+        usage.rss = std::stoull(line.substr(6)) * 1024;
+      } else if (line.compare(0, 6, "VmHWM:") == 0) {
+        usage.peakRSS = std::stoull(line.substr(6)) * 1024;
+      }
+    }
+#elif defined(__APPLE__)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                  reinterpret_cast<task_info_t>(&info),
+                  &count) == KERN_SUCCESS) {
+      usage.rss = info.resident_size;
+    }
+    struct rusage rusage;
+    if (getrusage(RUSAGE_SELF, &rusage) == 0) {
+      // ru_maxrss is given in bytes on macOS
+      usage.peakRSS = rusage.ru_maxrss;
+    }
+#endif
+    return usage;
+  }
+
+  static double toMegabytes(std::size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+  }
+};
+
+#endif
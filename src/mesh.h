@@ -1,130 +1,252 @@
 #ifndef _MESH_H
 #define _MESH_H
+#include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "glad/glad.h"
+#include "bounds.h"
+#include "geometry_arena.h"
 #include "glm/glm.hpp"
+#include "material_buffer.h"
+#include "multi_draw_indirect.h"
 #include "shader.h"
 #include "texture.h"
+#include "vertex_format.h"
 
-struct Vertex {
-  glm::vec3 position;   // vertex position
-  glm::vec3 normal;     // vertex normal
-  glm::vec2 texcoords;  // texture coordinates
+struct Material {
+  glm::vec3 kd{0.0f};  // diffuse color
+  glm::vec3 ks{0.0f};  // specular color
+  glm::vec3 ka{0.0f};  // ambient color
+  float shininess = 0.0f;
 };
 
-struct Material {
-  glm::vec3 kd;  // diffuse color
-  glm::vec3 ks;  // specular color
-  glm::vec3 ka;  // ambient color
-  float shininess;
+// mesh converted on the CPU, ready to be uploaded to the GPU.
+// geometry is either owned by the vectors or borrowed from a memory-mapped
+// mesh cache, so read it through vertexData() and indexData().
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  Material material;
+  std::vector<unsigned int> indicesOfTextures;  // indices of textures
+  Bounds bounds;  // in mesh space
+
+  // borrowed geometry
+  const Vertex* mappedVertices = nullptr;
+  std::size_t nMappedVertices = 0;
+  const unsigned int* mappedIndices = nullptr;
+  std::size_t nMappedIndices = 0;
+
+  const Vertex* vertexData() const {
+    return mappedVertices ? mappedVertices : vertices.data();
+  }
+  std::size_t vertexCount() const {
+    return mappedVertices ? nMappedVertices : vertices.size();
+  }
+  const unsigned int* indexData() const {
+    return mappedIndices ? mappedIndices : indices.data();
+  }
+  std::size_t indexCount() const {
+    return mappedIndices ? nMappedIndices : indices.size();
+  }
+
+  // copy borrowed geometry into the vectors, so that data outlives the
+  // mapping
+  void makeOwned() {
+    if (mappedVertices) {
+      vertices.assign(mappedVertices, mappedVertices + nMappedVertices);
+      mappedVertices = nullptr;
+      nMappedVertices = 0;
+    }
+    if (mappedIndices) {
+      indices.assign(mappedIndices, mappedIndices + nMappedIndices);
+      mappedIndices = nullptr;
+      nMappedIndices = 0;
+    }
+  }
 };
 
+// GPU side of a mesh, stored in a range of a GeometryArena. CPU geometry is
+// released after upload unless requested otherwise.
 class Mesh {
  public:
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
   Material material;
+  std::uint32_t materialIndex = 0;  // in the MaterialBuffer of the model
   std::vector<unsigned int> indicesOfTextures;  // indices of textures
+  TextureLayer diffuseTexture;   // first diffuse texture, if any
+  TextureLayer specularTexture;  // first specular texture, if any
+  // instances of the mesh, a range in the TransformBuffer of the model.
+  // the first nVisibleInstances slots of the range list the instances left
+  // visible by culling, which are drawn.
+  std::uint32_t firstInstance = 0;
+  std::uint32_t nInstances = 1;
+  std::uint32_t nVisibleInstances = 1;
+
+  // borrowed geometry is uploaded straight from the mapped cache
+  Mesh(MeshData&& data, GeometryArena& arena,
+       VertexFormat vertexFormat = VertexFormat::Float, bool keepData = false)
+      : material(data.material),
+        indicesOfTextures(data.indicesOfTextures),
+        bounds(data.bounds),
+        vertexFormat(vertexFormat) {
+    setupBuffers(arena, data.vertexData(), data.vertexCount(),
+                 data.indexData(), data.indexCount());
+
+    if (keepData) {
+      data.makeOwned();
+      this->data = std::move(data);
+    }
+  }
 
-  Mesh(const std::vector<Vertex>& vertices,
-       const std::vector<unsigned int>& indices, const Material& material,
-       const std::vector<unsigned int>& indicesOfTextures)
-      : vertices(vertices),
-        indices(indices),
-        material(material),
-        indicesOfTextures(indicesOfTextures) {
-    // setup VBO, EBO, VAO
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-
-    // VBO
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-                 vertices.data(), GL_STATIC_DRAW);
-
-    // EBO
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-                 indices.data(), GL_STATIC_DRAW);
-
-    // position
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          reinterpret_cast<void*>(0));
-    // normal
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          reinterpret_cast<void*>(offsetof(Vertex, normal)));
-
-    // texcoords
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                          reinterpret_cast<void*>(offsetof(Vertex, texcoords)));
-
-    glBindVertexArray(0);
+  std::size_t getNumVertices() const { return nVertices; }
+  std::size_t getNumIndices() const { return nIndices; }
+  VertexFormat getVertexFormat() const { return vertexFormat; }
+  const Bounds& getBounds() const { return bounds; }
+  GLenum getIndexType() const { return indexType; }
+  std::size_t getIndexSize() const {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
   }
 
-  void destroy() {
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &EBO);
-    glDeleteVertexArrays(1, &VAO);
-    vertices.clear();
-    indices.clear();
+  // CPU copy of the geometry, if it was kept at upload
+  const std::optional<MeshData>& getData() const { return data; }
+
+  // free range in given arena, which must be the one the mesh was created in
+  void destroy(GeometryArena& arena) {
+    arena.free(range);
+    range = GeometryArena::Range();
     indicesOfTextures.clear();
+    diffuseTexture = TextureLayer();
+    specularTexture = TextureLayer();
+    data.reset();
   }
 
-  // draw mesh by given shader
-  void draw(const Shader& shader, const std::vector<Texture>& textures) const {
-    // set material
-    shader.setUniform("kd", material.kd);
-    shader.setUniform("ks", material.ks);
-    shader.setUniform("ka", material.ka);
-    shader.setUniform("shininess", material.shininess);
-
-    // set texture uniform
-    std::size_t n_diffuse = 0;
-    std::size_t n_specular = 0;
-    for (std::size_t i = 0; i < indicesOfTextures.size(); ++i) {
-      const Texture& texture = textures[indicesOfTextures[i]];
-      const int textureUnitNumber = i;
-
-      switch (texture.textureType) {
-        case TextureType::DIFFUSE: {
-          const std::string uniformName =
-              "diffuseTextures[" + std::to_string(n_diffuse) + "]";
-          shader.setUniformTexture(uniformName, texture.id, textureUnitNumber);
-          n_diffuse++;
-          break;
-        }
-        case TextureType::SPECULAR: {
-          const std::string uniformName =
-              "specularTextures[" + std::to_string(n_specular) + "]";
-          shader.setUniformTexture(uniformName, texture.id, textureUnitNumber);
-          n_specular++;
-          break;
-        }
-      }
-    }
-    shader.setUniform("hasDiffuseTextures", n_diffuse > 0);
-    shader.setUniform("hasSpecularTextures", n_specular > 0);
+  // texture units of the diffuse and specular texture arrays
+  static constexpr GLuint DIFFUSE_TEXTURE_UNIT = 0;
+  static constexpr GLuint SPECULAR_TEXTURE_UNIT = 1;
+
+  // point texture array samplers of given shader to their units
+  static void setupShader(const Shader& shader) {
+    shader.setUniform("diffuseTextures",
+                      static_cast<GLint>(DIFFUSE_TEXTURE_UNIT));
+    shader.setUniform("specularTextures",
+                      static_cast<GLint>(SPECULAR_TEXTURE_UNIT));
+  }
+
+  // draw mesh by given shader. VAO of the arena and the material window of
+  // the mesh must be bound.
+  void draw(const Shader& shader,
+            const std::vector<TextureArray>& textureArrays) const {
+    // select material
+    shader.setUniform("materialIndex",
+                      MaterialBuffer::getIndexInWindow(materialIndex));
+    shader.setUniform("firstInstance", static_cast<GLint>(firstInstance));
+
+    // set vertex decoding
+    shader.setUniform("positionOffset", dequantization.offset);
+    shader.setUniform("positionScale", dequantization.scale);
+    shader.setUniform("octahedralNormals",
+                      vertexFormat != VertexFormat::Float);
+
+    bindTextures(textureArrays);
 
     // draw mesh
-    glBindVertexArray(VAO);
     shader.activate();
-    glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    shader.deactivate();
-    glBindVertexArray(0);
+    glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, nIndices, indexType,
+        reinterpret_cast<void*>(range.indexOffset), nVisibleInstances,
+        range.baseVertex);
+  }
+
+  // bind texture arrays holding the textures of mesh. the layers are
+  // selected by the material.
+  void bindTextures(const std::vector<TextureArray>& textureArrays) const {
+    if (diffuseTexture) {
+      Shader::bindTexture(textureArrays[diffuseTexture.array].id,
+                          DIFFUSE_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY);
+    }
+    if (specularTexture) {
+      Shader::bindTexture(textureArrays[specularTexture.array].id,
+                          SPECULAR_TEXTURE_UNIT, GL_TEXTURE_2D_ARRAY);
+    }
+  }
+
+  // material block entry of mesh, with the texture layers or -1 for
+  // missing textures
+  MaterialBlockEntry getMaterialBlockEntry() const {
+    const auto getLayer = [](const TextureLayer& texture) {
+      return texture ? static_cast<float>(texture.layer) : -1.0f;
+    };
+
+    MaterialBlockEntry entry;
+    entry.kd = glm::vec4(material.kd, material.shininess);
+    entry.ks = glm::vec4(material.ks, getLayer(diffuseTexture));
+    entry.ka = glm::vec4(material.ka, getLayer(specularTexture));
+    return entry;
+  }
+
+  // per-draw data read by the shaders in multi-draw indirect rendering,
+  // MultiDrawIndirect::DRAW_DATA_STRIDE vec4s
+  void getDrawData(std::vector<glm::vec4>& drawData) const {
+    drawData.emplace_back(dequantization.offset,
+                          vertexFormat != VertexFormat::Float ? 1.0f : 0.0f);
+    drawData.emplace_back(
+        dequantization.scale,
+        static_cast<float>(MaterialBuffer::getIndexInWindow(materialIndex)));
+    drawData.emplace_back(static_cast<float>(firstInstance), 0.0f, 0.0f, 0.0f);
+  }
+
+  // indirect draw command of mesh, passing drawID as base instance
+  DrawElementsIndirectCommand getDrawCommand(GLuint drawID) const {
+    DrawElementsIndirectCommand command;
+    command.count = nIndices;
+    command.instanceCount = nVisibleInstances;
+    command.firstIndex = range.indexOffset / getIndexSize();
+    command.baseVertex = range.baseVertex;
+    command.baseInstance = drawID;
+    return command;
   }
 
  private:
-  GLuint VAO;
-  GLuint VBO;
-  GLuint EBO;
+  Bounds bounds;
+  GeometryArena::Range range;
+  std::size_t nVertices;
+  std::size_t nIndices;
+  GLenum indexType;
+  VertexFormat vertexFormat;
+  VertexPacker::Dequantization dequantization;
+  std::optional<MeshData> data;
+
+  void setupBuffers(GeometryArena& arena, const Vertex* vertexData,
+                    std::size_t nVertices, const unsigned int* indexData,
+                    std::size_t nIndices) {
+    this->nVertices = nVertices;
+    this->nIndices = nIndices;
+
+    // vertices
+    const std::vector<unsigned char> packedVertices =
+        VertexPacker::pack(vertexFormat, vertexData, nVertices, dequantization);
+    const void* vertices = vertexFormat == VertexFormat::Float
+                               ? static_cast<const void*>(vertexData)
+                               : packedVertices.data();
+
+    // indices are narrowed to 16 bits whenever they fit
+    std::vector<GLushort> shortIndices;
+    const void* indices = indexData;
+    std::size_t indexBytes = nIndices * sizeof(GLuint);
+    if (nVertices <= 65536) {
+      indexType = GL_UNSIGNED_SHORT;
+      shortIndices.assign(indexData, indexData + nIndices);
+      indices = shortIndices.data();
+      indexBytes = nIndices * sizeof(GLushort);
+    } else {
+      indexType = GL_UNSIGNED_INT;
+    }
+
+    range = arena.allocate(vertexFormat, vertices, nVertices, indices,
+                           indexBytes);
+  }
 };
 
 #endif
\ No newline at end of file
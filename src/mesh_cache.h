@@ -0,0 +1,453 @@
+#ifndef _MESH_CACHE_H
+#define _MESH_CACHE_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "scene_graph.h"
+#include "texture.h"
+#include "thread_pool.h"
+
+// on-disk cache of converted meshes, so that reloading an unchanged model
+// skips assimp. cache files are memory-mapped and the geometry is uploaded
+// straight from the mapping. entries are keyed by the source path, its
+// modification time and size and the import flags, and by modification time
+// and size of side files read along with the source, such as .mtl files.
+//
+// file layout(all sections aligned to 16 bytes):
+//   Header, source path
+//   per side file: SideFileRecord, side file path
+//   per texture: TextureRecord, texture path
+//   per mesh: MeshRecord, indices of textures
+//   parents of nodes, local transforms of nodes, mesh instances
+//   per mesh: vertices, indices
+class MeshCache {
+ public:
+  // bump when the layout of the file or of Vertex/Material/Bounds/
+  // AffineTransform/MeshInstance changes, or when conversion produces
+  // different meshes
+  static constexpr std::uint32_t VERSION = 6;
+
+  // geometry and textures read from a cache file. meshes borrow their
+  // geometry from file, which must stay alive until they are uploaded.
+  struct Entry {
+    std::unique_ptr<MappedFile> file;
+    std::vector<MeshData> meshes;
+    std::vector<std::pair<std::string, TextureType>> textures;
+    std::vector<std::string> sideFiles;
+    SceneGraph sceneGraph;
+    std::vector<MeshInstance> instances;
+  };
+
+  // read cache entry of given model. flags identify the import settings;
+  // returns nullopt when there is no valid entry.
+  static std::optional<Entry> load(const std::string& filepath,
+                                   std::uint64_t flags) {
+    const std::optional<FileInfo> source = getFileInfo(filepath);
+    if (!source || !source->exists) return std::nullopt;
+
+    auto file = std::make_unique<MappedFile>();
+    if (!file->open(cachePath(source->path).string())) return std::nullopt;
+
+    Reader reader{file->data(), file->size()};
+
+    // validate key
+    const Header* header = reader.read<Header>();
+    if (!header || std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header->version != VERSION || header->flags != flags ||
+        header->sourceTime != source->time ||
+        header->sourceSize != source->size) {
+      return std::nullopt;
+    }
+    const std::optional<std::string> sourcePath =
+        reader.readString(header->sourcePathLength);
+    if (!sourcePath || sourcePath.value() != source->path) return std::nullopt;
+
+    Entry entry;
+
+    // side files. missing ones are recorded too, so that creating them
+    // invalidates the entry.
+    for (std::uint32_t i = 0; i < header->nSideFiles; ++i) {
+      const SideFileRecord* record = reader.read<SideFileRecord>();
+      if (!record) return std::nullopt;
+      const std::optional<std::string> sideFilePath =
+          reader.readString(record->pathLength);
+      if (!sideFilePath) return std::nullopt;
+      const std::optional<FileInfo> sideFile =
+          getFileInfo(sideFilePath.value());
+      if (!sideFile || sideFile->exists != (record->exists != 0) ||
+          sideFile->time != record->time || sideFile->size != record->size) {
+        return std::nullopt;
+      }
+      entry.sideFiles.push_back(sideFilePath.value());
+    }
+
+    // textures
+    for (std::uint32_t i = 0; i < header->nTextures; ++i) {
+      const TextureRecord* record = reader.read<TextureRecord>();
+      if (!record) return std::nullopt;
+      const std::optional<std::string> texturePath =
+          reader.readString(record->pathLength);
+      if (!texturePath) return std::nullopt;
+      if (record->type != static_cast<std::uint32_t>(TextureType::DIFFUSE) &&
+          record->type != static_cast<std::uint32_t>(TextureType::SPECULAR)) {
+        return std::nullopt;
+      }
+      entry.textures.emplace_back(texturePath.value(),
+                                  static_cast<TextureType>(record->type));
+    }
+
+    // meshes
+    entry.meshes.resize(header->nMeshes);
+    for (auto& mesh : entry.meshes) {
+      const MeshRecord* record = reader.read<MeshRecord>();
+      if (!record) return std::nullopt;
+      mesh.material = record->material;
+      mesh.bounds = record->bounds;
+      mesh.nMappedVertices = record->nVertices;
+      mesh.nMappedIndices = record->nIndices;
+
+      const std::uint32_t* indicesOfTextures =
+          reader.readArray<std::uint32_t>(record->nTextures);
+      if (!indicesOfTextures) return std::nullopt;
+      if (std::any_of(indicesOfTextures, indicesOfTextures + record->nTextures,
+                      [&](std::uint32_t index) {
+                        return index >= header->nTextures;
+                      })) {
+        return std::nullopt;
+      }
+      mesh.indicesOfTextures.assign(indicesOfTextures,
+                                    indicesOfTextures + record->nTextures);
+    }
+
+    // scene graph. parents must precede their children.
+    const std::int32_t* parents =
+        reader.readArray<std::int32_t>(header->nNodes);
+    const AffineTransform* locals =
+        reader.readArray<AffineTransform>(header->nNodes);
+    if (!parents || !locals) return std::nullopt;
+    for (std::uint32_t i = 0; i < header->nNodes; ++i) {
+      if (parents[i] != SceneGraph::NO_PARENT &&
+          (parents[i] < 0 || static_cast<std::uint32_t>(parents[i]) >= i)) {
+        return std::nullopt;
+      }
+      entry.sceneGraph.addNode(parents[i], locals[i]);
+    }
+    const MeshInstance* instances =
+        reader.readArray<MeshInstance>(header->nInstances);
+    if (!instances) return std::nullopt;
+    for (std::uint32_t i = 0; i < header->nInstances; ++i) {
+      if (instances[i].mesh >= header->nMeshes ||
+          instances[i].node >= header->nNodes) {
+        return std::nullopt;
+      }
+    }
+    entry.instances.assign(instances, instances + header->nInstances);
+
+    // geometry
+    for (auto& mesh : entry.meshes) {
+      mesh.mappedVertices = reader.readArray<Vertex>(mesh.nMappedVertices);
+      mesh.mappedIndices = reader.readArray<unsigned int>(mesh.nMappedIndices);
+      if (!mesh.mappedVertices || !mesh.mappedIndices) return std::nullopt;
+    }
+
+    // indices must address vertices of their mesh. blocks of indices of all
+    // meshes are checked on worker threads.
+    std::vector<std::pair<std::size_t, std::size_t>> blocks;
+    for (std::size_t m = 0; m < entry.meshes.size(); ++m) {
+      for (std::size_t begin = 0; begin < entry.meshes[m].nMappedIndices;
+           begin += BLOCK_SIZE) {
+        blocks.emplace_back(m, begin);
+      }
+    }
+    std::atomic<bool> indicesInRange{true};
+    ThreadPool::shared().parallelFor(blocks.size(), [&](std::size_t b) {
+      const MeshData& mesh = entry.meshes[blocks[b].first];
+      const std::size_t end =
+          std::min(mesh.nMappedIndices, blocks[b].second + BLOCK_SIZE);
+      for (std::size_t i = blocks[b].second; i < end; ++i) {
+        if (mesh.mappedIndices[i] >= mesh.nMappedVertices) {
+          indicesInRange.store(false, std::memory_order_relaxed);
+          return;
+        }
+      }
+    });
+    if (!indicesInRange.load(std::memory_order_relaxed)) return std::nullopt;
+
+    entry.file = std::move(file);
+    return entry;
+  }
+
+  // write cache entry of given model. sideFiles are the other files read
+  // while importing it. textures are given by path since decoded images are
+  // not cached.
+  static bool store(const std::string& filepath, std::uint64_t flags,
+                    const std::vector<std::string>& sideFiles,
+                    const std::vector<MeshData>& meshes,
+                    const std::vector<std::pair<std::string, TextureType>>&
+                        textures,
+                    const SceneGraph& sceneGraph,
+                    const std::vector<MeshInstance>& instances) {
+    const std::optional<FileInfo> source = getFileInfo(filepath);
+    if (!source || !source->exists) return false;
+
+    // side files may be opened several times, and the source among them
+    std::vector<FileInfo> sideFileInfos;
+    for (const auto& sideFile : sideFiles) {
+      std::optional<FileInfo> info = getFileInfo(sideFile);
+      if (!info) return false;
+      const auto samePath = [&](const FileInfo& other) {
+        return other.path == info->path;
+      };
+      if (info->path == source->path ||
+          std::any_of(sideFileInfos.begin(), sideFileInfos.end(), samePath)) {
+        continue;
+      }
+      sideFileInfos.push_back(std::move(info.value()));
+    }
+
+    const std::filesystem::path path = cachePath(source->path);
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // write to temporary file first, so that readers never see a partial file.
+    // its name is unique per writer, so that loads of the same model on
+    // several threads do not write into each other's file.
+    static std::atomic<std::uint64_t> nextWriter{0};
+    std::ostringstream tmpSuffix;
+    tmpSuffix << '.' << std::hex
+              << std::hash<std::thread::id>{}(std::this_thread::get_id())
+              << '-' << nextWriter.fetch_add(1, std::memory_order_relaxed)
+              << ".tmp";
+    std::filesystem::path tmpPath = path;
+    tmpPath += tmpSuffix.str();
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::cerr << "[MeshCache] failed to create " << tmpPath << std::endl;
+      return false;
+    }
+    Writer writer{file};
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.flags = flags;
+    header.sourceTime = source->time;
+    header.sourceSize = source->size;
+    header.sourcePathLength = source->path.size();
+    header.nSideFiles = sideFileInfos.size();
+    header.nTextures = textures.size();
+    header.nMeshes = meshes.size();
+    header.nNodes = sceneGraph.getNumNodes();
+    header.nInstances = instances.size();
+    writer.write(&header, sizeof(Header));
+    writer.write(source->path.data(), source->path.size());
+
+    for (const auto& sideFile : sideFileInfos) {
+      SideFileRecord record{};
+      record.time = sideFile.time;
+      record.size = sideFile.size;
+      record.pathLength = sideFile.path.size();
+      record.exists = sideFile.exists;
+      writer.write(&record, sizeof(SideFileRecord));
+      writer.write(sideFile.path.data(), sideFile.path.size());
+    }
+
+    for (const auto& [texturePath, textureType] : textures) {
+      TextureRecord record{};
+      record.type = static_cast<std::uint32_t>(textureType);
+      record.pathLength = texturePath.size();
+      writer.write(&record, sizeof(TextureRecord));
+      writer.write(texturePath.data(), texturePath.size());
+    }
+
+    for (const auto& mesh : meshes) {
+      MeshRecord record{};
+      record.nVertices = mesh.vertexCount();
+      record.nIndices = mesh.indexCount();
+      record.material = mesh.material;
+      record.bounds = mesh.bounds;
+      record.nTextures = mesh.indicesOfTextures.size();
+      writer.write(&record, sizeof(MeshRecord));
+      writer.write(mesh.indicesOfTextures.data(),
+                   mesh.indicesOfTextures.size() * sizeof(unsigned int));
+    }
+
+    writer.write(sceneGraph.getParents().data(),
+                 sceneGraph.getNumNodes() * sizeof(std::int32_t));
+    writer.write(sceneGraph.getLocals().data(),
+                 sceneGraph.getNumNodes() * sizeof(AffineTransform));
+    writer.write(instances.data(), instances.size() * sizeof(MeshInstance));
+
+    for (const auto& mesh : meshes) {
+      writer.write(mesh.vertexData(), mesh.vertexCount() * sizeof(Vertex));
+      writer.write(mesh.indexData(), mesh.indexCount() * sizeof(unsigned int));
+    }
+
+    file.close();
+    if (!file) {
+      std::cerr << "[MeshCache] failed to write " << tmpPath << std::endl;
+      std::filesystem::remove(tmpPath, ec);
+      return false;
+    }
+
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+      std::cerr << "[MeshCache] failed to write " << path << std::endl;
+      std::filesystem::remove(tmpPath, ec);
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  static constexpr char MAGIC[8] = {'S', 'M', 'V', 'C', 'A', 'C', 'H', 'E'};
+  static constexpr std::size_t ALIGNMENT = 16;
+  // indices validated per task when loading
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+  struct Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t sourcePathLength;
+    std::uint64_t flags;
+    std::int64_t sourceTime;
+    std::uint64_t sourceSize;
+    std::uint32_t nSideFiles;
+    std::uint32_t nTextures;
+    std::uint32_t nMeshes;
+    std::uint32_t nNodes;
+    std::uint32_t nInstances;
+  };
+
+  struct SideFileRecord {
+    std::int64_t time;
+    std::uint64_t size;
+    std::uint32_t pathLength;
+    std::uint32_t exists;
+  };
+
+  struct TextureRecord {
+    std::uint32_t type;
+    std::uint32_t pathLength;
+  };
+
+  struct MeshRecord {
+    std::uint64_t nVertices;
+    std::uint64_t nIndices;
+    Material material;
+    Bounds bounds;
+    std::uint32_t nTextures;
+  };
+
+  // modification time and size of a source model or side file, used as
+  // cache key. both are zero for missing files.
+  struct FileInfo {
+    std::string path;  // absolute path
+    bool exists = false;
+    std::int64_t time = 0;
+    std::uint64_t size = 0;
+  };
+
+  // returns nullopt when the path cannot be made absolute
+  static std::optional<FileInfo> getFileInfo(const std::string& filepath) {
+    std::error_code ec;
+    const std::filesystem::path path =
+        std::filesystem::absolute(filepath, ec).lexically_normal();
+    if (ec) return std::nullopt;
+
+    FileInfo info;
+    info.path = path.string();
+    const std::int64_t time = std::filesystem::last_write_time(path, ec)
+                                  .time_since_epoch()
+                                  .count();
+    if (ec) return info;
+    const std::uint64_t size = std::filesystem::file_size(path, ec);
+    if (ec) return info;
+
+    info.exists = true;
+    info.time = time;
+    info.size = size;
+    return info;
+  }
+
+  // cache files live in the temp directory, named by hash of source path
+  static std::filesystem::path cachePath(const std::string& sourcePath) {
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec);
+    if (ec) dir = ".";
+
+    std::stringstream ss;
+    ss << std::hex << std::hash<std::string>{}(sourcePath) << ".meshcache";
+    return dir / "simple-model-viewer" / ss.str();
+  }
+
+  static std::size_t alignUp(std::size_t offset) {
+    return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
+
+  // writes sections aligned to ALIGNMENT
+  struct Writer {
+    std::ofstream& file;
+    std::size_t offset = 0;
+
+    void write(const void* data, std::size_t size) {
+      file.write(static_cast<const char*>(data), size);
+      offset += size;
+
+      static const char zeros[ALIGNMENT] = {};
+      const std::size_t padding = alignUp(offset) - offset;
+      file.write(zeros, padding);
+      offset += padding;
+    }
+  };
+
+  // bounds-checked reader over the mapped file
+  struct Reader {
+    const unsigned char* data;
+    std::size_t size;
+    std::size_t offset = 0;
+
+    const void* read(std::size_t bytes) {
+      if (bytes > size - offset) return nullptr;
+      const void* ptr = data + offset;
+      offset = std::min(alignUp(offset + bytes), size);
+      return ptr;
+    }
+
+    template <typename T>
+    const T* read() {
+      return static_cast<const T*>(read(sizeof(T)));
+    }
+
+    template <typename T>
+    const T* readArray(std::size_t n) {
+      if (n > size / sizeof(T)) return nullptr;
+      // empty arrays still need a valid pointer
+      return static_cast<const T*>(read(n * sizeof(T)));
+    }
+
+    std::optional<std::string> readString(std::size_t length) {
+      const char* ptr = static_cast<const char*>(read(length));
+      if (!ptr) return std::nullopt;
+      return std::string(ptr, length);
+    }
+  };
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef _MESH_NORMALS_H
+#define _MESH_NORMALS_H
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "thread_pool.h"
+#include "vertex_format.h"
+
+// smooth vertex normals of indexed triangle meshes, computed on worker
+// threads. every vertex sums the area-weighted normals of its triangles.
+class MeshNormals {
+ public:
+  // replace normals of given vertices. triangles are summed in index order,
+  // so results do not depend on the number of threads. vertices of no or
+  // only degenerate triangles get zero normals. indices must be in range.
+  static void computeSmooth(std::vector<Vertex>& vertices,
+                            const std::vector<unsigned int>& indices) {
+    const std::size_t nVertices = vertices.size();
+    const std::size_t nCorners = indices.size() / 3 * 3;
+    const std::size_t nCornerBlocks = (nCorners + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const std::size_t nVertexBlocks =
+        (nVertices + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ThreadPool& pool = ThreadPool::shared();
+
+    // corners grouped by vertex. ends[v] counts the corners of vertex v,
+    // then holds their start, which the scatter advances to their end.
+    std::vector<std::atomic<std::uint32_t>> ends(nVertices);
+    pool.parallelFor(nCornerBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        ends[indices[c]].fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    std::uint32_t offset = 0;
+    for (auto& end : ends) {
+      const std::uint32_t count = end.load(std::memory_order_relaxed);
+      end.store(offset, std::memory_order_relaxed);
+      offset += count;
+    }
+    std::vector<std::uint32_t> corners(nCorners);
+    pool.parallelFor(nCornerBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        corners[ends[indices[c]].fetch_add(1, std::memory_order_relaxed)] =
+            static_cast<std::uint32_t>(c);
+      }
+    });
+
+    // area-weighted face normals, so that vertices gather one value per
+    // corner
+    const std::size_t nTriangles = nCorners / 3;
+    std::vector<glm::vec3> faceNormals(nTriangles);
+    pool.parallelFor((nTriangles + BLOCK_SIZE - 1) / BLOCK_SIZE,
+                     [&](std::size_t b) {
+      const std::size_t end = std::min(nTriangles, (b + 1) * BLOCK_SIZE);
+      for (std::size_t t = b * BLOCK_SIZE; t < end; ++t) {
+        const glm::vec3& p0 = vertices[indices[3 * t]].position;
+        const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+        const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+        faceNormals[t] = glm::cross(p1 - p0, p2 - p0);
+      }
+    });
+
+    pool.parallelFor(nVertexBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nVertices, (b + 1) * BLOCK_SIZE);
+      for (std::size_t v = b * BLOCK_SIZE; v < end; ++v) {
+        const auto first = corners.begin() +
+                           (v > 0 ? ends[v - 1].load(std::memory_order_relaxed)
+                                  : 0);
+        const auto last =
+            corners.begin() + ends[v].load(std::memory_order_relaxed);
+        std::sort(first, last);
+
+        glm::vec3 normal(0.0f);
+        for (auto it = first; it != last; ++it) {
+          normal += faceNormals[*it / 3];
+        }
+        const float length = glm::length(normal);
+        vertices[v].normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+      }
+    });
+  }
+
+ private:
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+};
+
+#endif
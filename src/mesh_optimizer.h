@@ -0,0 +1,319 @@
+#ifndef _MESH_OPTIMIZER_H
+#define _MESH_OPTIMIZER_H
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "mesh.h"
+
+// efficiency of an index buffer on a simulated FIFO post-transform cache
+struct VertexCacheStatistics {
+  float acmr = 0.0f;  // transformed vertices per triangle
+  float atvr = 0.0f;  // transformed vertices per referenced vertex
+};
+
+// reorders triangles and vertices of a mesh for the GPU's vertex caches.
+//
+// triangles are reordered with Tipsify(Sander et al., "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw", 2007), then the
+// clusters Tipsify leaves at cache flushes are sorted outside-in to reduce
+// overdraw, and finally vertices are renumbered in order of first use for
+// pre-transform cache locality.
+class MeshOptimizer {
+ public:
+  static constexpr std::size_t CACHE_SIZE = 16;
+
+  struct Statistics {
+    VertexCacheStatistics before;
+    VertexCacheStatistics after;
+    std::size_t nTriangles = 0;
+    std::size_t nVertices = 0;
+  };
+
+  static Statistics optimize(std::vector<Vertex>& vertices,
+                             std::vector<unsigned int>& indices) {
+    Statistics statistics;
+    statistics.before = analyzeVertexCache(indices, vertices.size());
+
+    if (indices.size() >= 3 && !vertices.empty()) {
+      std::vector<std::size_t> clusters;
+      indices = tipsify(indices, vertices.size(), CACHE_SIZE, clusters);
+      sortClusters(vertices, indices, clusters);
+      optimizeVertexFetch(vertices, indices);
+    }
+
+    statistics.after = analyzeVertexCache(indices, vertices.size());
+    statistics.nTriangles = indices.size() / 3;
+    statistics.nVertices = vertices.size();
+    return statistics;
+  }
+
+  // split mesh into sub-meshes referencing at most maxVertices vertices
+  // each, keeping triangle order. meshes already small enough are returned
+  // as is.
+  static std::vector<MeshData> split(MeshData&& mesh,
+                                     std::size_t maxVertices = 1 << 16) {
+    std::vector<MeshData> subMeshes;
+    if (mesh.vertexCount() <= maxVertices) {
+      subMeshes.push_back(std::move(mesh));
+      return subMeshes;
+    }
+
+    const Vertex* vertices = mesh.vertexData();
+    const unsigned int* indices = mesh.indexData();
+    const std::size_t nIndices = mesh.indexCount();
+
+    // remap[v] is valid for current sub-mesh when stamp[v] == subMesh index
+    constexpr std::size_t NONE = ~std::size_t(0);
+    std::vector<unsigned int> remap(mesh.vertexCount());
+    std::vector<std::size_t> stamp(mesh.vertexCount(), NONE);
+
+    MeshData current;
+    for (std::size_t i = 0; i + 2 < nIndices; i += 3) {
+      // count vertices the triangle would add
+      std::size_t nNew = 0;
+      for (std::size_t k = 0; k < 3; ++k) {
+        if (stamp[indices[i + k]] != subMeshes.size()) nNew++;
+      }
+      if (current.vertices.size() + nNew > maxVertices) {
+        current.material = mesh.material;
+        current.indicesOfTextures = mesh.indicesOfTextures;
+        current.bounds =
+            Bounds::compute(current.vertices.data(), current.vertices.size());
+        subMeshes.push_back(std::move(current));
+        current = MeshData();
+      }
+
+      for (std::size_t k = 0; k < 3; ++k) {
+        const unsigned int v = indices[i + k];
+        if (stamp[v] != subMeshes.size()) {
+          stamp[v] = subMeshes.size();
+          remap[v] = current.vertices.size();
+          current.vertices.push_back(vertices[v]);
+        }
+        current.indices.push_back(remap[v]);
+      }
+    }
+    if (!current.indices.empty()) {
+      current.material = mesh.material;
+      current.indicesOfTextures = mesh.indicesOfTextures;
+      current.bounds =
+          Bounds::compute(current.vertices.data(), current.vertices.size());
+      subMeshes.push_back(std::move(current));
+    }
+
+    return subMeshes;
+  }
+
+  // simulate FIFO cache of given size
+  static VertexCacheStatistics analyzeVertexCache(
+      const std::vector<unsigned int>& indices, std::size_t nVertices,
+      std::size_t cacheSize = CACHE_SIZE) {
+    VertexCacheStatistics statistics;
+    if (indices.size() < 3 || nVertices == 0) return statistics;
+
+    // a vertex is in cache while fewer than cacheSize misses happened since
+    // it was loaded
+    std::vector<std::size_t> cacheTime(nVertices, 0);
+    std::vector<bool> referenced(nVertices, false);
+    std::size_t time = cacheSize + 1;
+    std::size_t nMisses = 0;
+    std::size_t nReferenced = 0;
+    for (const unsigned int index : indices) {
+      if (time - cacheTime[index] > cacheSize) {
+        cacheTime[index] = time;
+        time++;
+        nMisses++;
+      }
+      if (!referenced[index]) {
+        referenced[index] = true;
+        nReferenced++;
+      }
+    }
+
+    statistics.acmr = static_cast<float>(nMisses) / (indices.size() / 3);
+    statistics.atvr = static_cast<float>(nMisses) / nReferenced;
+    return statistics;
+  }
+
+ private:
+  // returns reordered indices. clusters receives the index offsets where
+  // Tipsify had to jump to a vertex outside the cache.
+  static std::vector<unsigned int> tipsify(
+      const std::vector<unsigned int>& indices, std::size_t nVertices,
+      std::size_t cacheSize, std::vector<std::size_t>& clusters) {
+    const std::size_t nTriangles = indices.size() / 3;
+
+    // vertex-triangle adjacency
+    std::vector<std::uint32_t> offsets(nVertices + 1, 0);
+    for (const unsigned int index : indices) {
+      offsets[index + 1]++;
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    std::vector<std::uint32_t> adjacency(indices.size());
+    std::vector<std::uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t t = 0; t < nTriangles; ++t) {
+      for (std::size_t k = 0; k < 3; ++k) {
+        adjacency[fill[indices[3 * t + k]]++] = t;
+      }
+    }
+
+    // number of triangles not emitted yet
+    std::vector<std::uint32_t> live(nVertices);
+    for (std::size_t v = 0; v < nVertices; ++v) {
+      live[v] = offsets[v + 1] - offsets[v];
+    }
+
+    std::vector<std::size_t> cacheTime(nVertices, 0);
+    std::vector<bool> emitted(nTriangles, false);
+    std::vector<unsigned int> deadEnd;
+    std::vector<unsigned int> candidates;
+    std::vector<unsigned int> output;
+    output.reserve(indices.size());
+
+    std::size_t time = cacheSize + 1;
+    std::size_t cursor = 0;
+    long fanning = indices[0];
+    clusters.push_back(0);
+
+    while (fanning >= 0) {
+      // emit all triangles around fanning vertex
+      candidates.clear();
+      for (std::uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; ++a) {
+        const std::uint32_t t = adjacency[a];
+        if (emitted[t]) continue;
+
+        for (std::size_t k = 0; k < 3; ++k) {
+          const unsigned int v = indices[3 * t + k];
+          output.push_back(v);
+          deadEnd.push_back(v);
+          candidates.push_back(v);
+          live[v]--;
+          if (time - cacheTime[v] > cacheSize) {
+            cacheTime[v] = time;
+            time++;
+          }
+        }
+        emitted[t] = true;
+      }
+
+      // pick the next fanning vertex among the ones still in cache
+      long best = -1;
+      long bestPriority = -1;
+      for (const unsigned int v : candidates) {
+        if (live[v] == 0) continue;
+        long priority = 0;
+        if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+          priority = time - cacheTime[v];
+        }
+        if (priority > bestPriority) {
+          best = v;
+          bestPriority = priority;
+        }
+      }
+
+      // dead end: the cache is effectively flushed from here on
+      if (best < 0) {
+        while (!deadEnd.empty() && best < 0) {
+          const unsigned int v = deadEnd.back();
+          deadEnd.pop_back();
+          if (live[v] > 0) best = v;
+        }
+        while (best < 0 && cursor < nVertices) {
+          if (live[cursor] > 0) best = cursor;
+          cursor++;
+        }
+        if (best >= 0 && output.size() < indices.size()) {
+          clusters.push_back(output.size());
+        }
+      }
+
+      fanning = best;
+    }
+
+    return output;
+  }
+
+  // order clusters so that the ones facing away from the mesh center are
+  // drawn first and occlude the inner ones
+  static void sortClusters(const std::vector<Vertex>& vertices,
+                           std::vector<unsigned int>& indices,
+                           const std::vector<std::size_t>& clusters) {
+    if (clusters.size() < 2) return;
+
+    // mesh centroid
+    glm::vec3 meshCenter(0.0f);
+    for (const auto& vertex : vertices) {
+      meshCenter += vertex.position;
+    }
+    meshCenter /= static_cast<float>(vertices.size());
+
+    // area weighted centroid and normal of each cluster
+    std::vector<float> sortKeys(clusters.size());
+    for (std::size_t c = 0; c < clusters.size(); ++c) {
+      const std::size_t begin = clusters[c];
+      const std::size_t end =
+          c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+
+      glm::vec3 center(0.0f);
+      glm::vec3 normal(0.0f);
+      float area = 0.0f;
+      for (std::size_t i = begin; i < end; i += 3) {
+        const glm::vec3& p0 = vertices[indices[i]].position;
+        const glm::vec3& p1 = vertices[indices[i + 1]].position;
+        const glm::vec3& p2 = vertices[indices[i + 2]].position;
+        const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+        const float a = glm::length(n);
+        center += a * (p0 + p1 + p2) / 3.0f;
+        normal += n;
+        area += a;
+      }
+      if (area > 0.0f) center /= area;
+      const float length = glm::length(normal);
+      if (length > 0.0f) normal /= length;
+
+      sortKeys[c] = glm::dot(center - meshCenter, normal);
+    }
+
+    std::vector<std::size_t> order(clusters.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                       return sortKeys[a] > sortKeys[b];
+                     });
+
+    std::vector<unsigned int> sorted;
+    sorted.reserve(indices.size());
+    for (const std::size_t c : order) {
+      const std::size_t begin = clusters[c];
+      const std::size_t end =
+          c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+      sorted.insert(sorted.end(), indices.begin() + begin,
+                    indices.begin() + end);
+    }
+    indices = std::move(sorted);
+  }
+
+  // renumber vertices in order of first use and drop unreferenced ones
+  static void optimizeVertexFetch(std::vector<Vertex>& vertices,
+                                  std::vector<unsigned int>& indices) {
+    constexpr unsigned int UNUSED = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto& index : indices) {
+      if (remap[index] == UNUSED) {
+        remap[index] = reordered.size();
+        reordered.push_back(vertices[index]);
+      }
+      index = remap[index];
+    }
+
+    vertices = std::move(reordered);
+  }
+};
+
+#endif
@@ -1,108 +1,1415 @@
 #ifndef _MODEL_H
 #define _MODEL_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <numeric>
 #include <optional>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 //
+#include <assimp/DefaultIOSystem.h>
 #include <assimp/postprocess.h>
 #include <assimp/scene.h>
 
 #include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
 
 #include "glad/glad.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 //
+#include "bounds.h"
+#include "bvh.h"
+#include "content_hash.h"
+#include "frustum_culler.h"
+#include "geometry_arena.h"
+#include "mapped_file.h"
+#include "material_buffer.h"
+#include "memory_usage.h"
 #include "mesh.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "multi_draw_indirect.h"
+#include "native_loader.h"
+#include "obj_loader.h"
+#include "occlusion_culler.h"
+#include "ply_loader.h"
+#include "radix_sort.h"
+#include "scene_graph.h"
 #include "shader.h"
+#include "stl_loader.h"
 #include "texture.h"
+#include "texture_uploader.h"
+#include "thread_pool.h"
+#include "transform_buffer.h"
+#include "vertex_format.h"
+
+// progress of a model load, shared between the loading thread and the caller
+struct LoadProgress {
+  std::atomic<float> value{0.0f};       // 0 to 1
+  std::atomic<bool> cancelled{false};  // set by the caller to abort loading
+};
+
+// settings of model loading
+struct LoadOptions {
+  bool useCache = true;         // read and write the mesh cache
+  bool keepCPUData = false;     // keep mesh geometry on the CPU after upload
+  bool optimizeMeshes = false;  // reorder triangles and vertices for caches
+  VertexFormat vertexFormat = VertexFormat::Float;  // layout on the GPU
+  bool splitMeshes = false;  // split meshes to fit 16-bit indices
+  TextureResizePolicy textureResize = TextureResizePolicy::None;
+  bool deduplicateTextures = true;  // decode identical texture files once
+  bool nativeLoaders = true;  // load OBJ, PLY and STL without assimp
+};
+
+// model loaded on the CPU, ready to be uploaded to the GPU
+struct ModelData {
+  std::string filepath;
+  LoadOptions options;
+  std::vector<MeshData> meshes;
+  std::vector<TextureData> textures;
+  std::vector<TextureLayer> textureLayers;  // per texture
+  std::vector<TextureArrayLayout> textureArrays;
+  std::vector<std::string> sideFiles;     // files read besides filepath
+  std::unique_ptr<MappedFile> cacheFile;  // backs meshes read from mesh cache
+  SceneGraph sceneGraph;
+  std::vector<MeshInstance> instances;  // grouped by mesh
+  std::vector<Bounds> instanceBounds;   // in world space
+  std::vector<Bounds> meshBounds;       // in world space, over instances
+  BVH meshBVH;                          // over meshBounds
+  std::vector<BVH> triangleBVHs;  // per mesh, only when CPU data is kept
+  Occluders occluders;            // for software occlusion culling
+};
+
+// closest mesh hit by a ray
+struct RayHit {
+  std::size_t meshIndex;
+  float distance;
+  bool exact;  // hit a triangle rather than the bounds of the mesh
+};
 
 class Model {
  public:
   Model() {}
-  Model(const std::string& filepath) { loadModel(filepath); }
+  Model(const std::string& filepath, GeometryArena& arena,
+        TextureUploader& textureUploader) {
+    loadModel(filepath, arena, textureUploader);
+  }
 
   operator bool() const { return meshes.size() > 0; }
 
-  // load model with assimp
-  void loadModel(const std::string& filepath) {
-    // load model with assimp
-    Assimp::Importer importer;
-    const aiScene* scene =
-        importer.ReadFile(filepath, aiProcess_Triangulate | aiProcess_FlipUVs |
-                                        aiProcess_GenNormals);
+  // load model with assimp, or a native loader for OBJ, PLY and STL files
+  void loadModel(const std::string& filepath, GeometryArena& arena,
+                 TextureUploader& textureUploader,
+                 const LoadOptions& options = LoadOptions()) {
+    std::optional<ModelData> data = importModel(filepath, options);
+    if (data) {
+      upload(std::move(data.value()), arena, textureUploader);
+    }
+  }
 
-    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
-        !scene->mRootNode) {
-      std::cerr << "[Assimp] " << importer.GetErrorString() << std::endl;
-      return;
+  // import model, convert meshes and decode textures on the CPU.
+  // this does not touch GL, so it may run on any thread.
+  // returns nullopt when loading failed or was cancelled.
+  static std::optional<ModelData> importModel(
+      const std::string& filepath, const LoadOptions& options = LoadOptions(),
+      LoadProgress* progress = nullptr) {
+    LoadProgress localProgress;
+    LoadProgress& status = progress ? *progress : localProgress;
+
+    ModelData data;
+    data.filepath = filepath;
+    data.options = options;
+
+    // try mesh cache first
+    if (options.useCache) {
+      const auto cacheStart = std::chrono::steady_clock::now();
+      std::optional<MeshCache::Entry> entry =
+          MeshCache::load(filepath, getCacheFlags(filepath, options));
+      if (entry) {
+        data.cacheFile = std::move(entry->file);
+        data.meshes = std::move(entry->meshes);
+        data.sceneGraph = std::move(entry->sceneGraph);
+        data.instances = std::move(entry->instances);
+        data.sideFiles = std::move(entry->sideFiles);
+        for (const auto& [texturePath, textureType] : entry->textures) {
+          data.textures.push_back({texturePath, textureType, Image()});
+        }
+
+        const auto cacheEnd = std::chrono::steady_clock::now();
+        std::cout << "[MeshCache] loaded " << filepath << " from cache in "
+                  << toMilliseconds(cacheEnd - cacheStart) << " ms"
+                  << std::endl;
+      }
     }
 
-    // process scene graph
-    const std::filesystem::path ps(filepath);
-    processNode(scene->mRootNode, scene, ps.parent_path());
+    if (!data.cacheFile) {
+      bool imported = false;
+      if (options.nativeLoaders && hasNativeLoader(filepath)) {
+        imported = importNative(filepath, options, data, status);
+        if (status.cancelled) return std::nullopt;
+        if (!imported) {
+          std::cout << "[Model] unsupported by native loader, loading "
+                    << filepath << " with assimp" << std::endl;
+          data.meshes.clear();
+          data.textures.clear();
+          data.sceneGraph.clear();
+          data.instances.clear();
+          data.sideFiles.clear();
+        }
+      }
+      if (!imported && !importScene(filepath, options, data, status)) {
+        return std::nullopt;
+      }
+      // meshes of a cancelled import may be partial, so they are not cached
+      if (status.cancelled) return std::nullopt;
+
+      if (options.useCache) {
+        std::vector<TextureReference> textureReferences;
+        for (const auto& texture : data.textures) {
+          textureReferences.emplace_back(texture.filepath, texture.textureType);
+        }
+        MeshCache::store(filepath, getCacheFlags(filepath, options),
+                         data.sideFiles, data.meshes, textureReferences,
+                         data.sceneGraph, data.instances);
+      }
+    }
+
+    // every node is dirty after loading, so this is a full propagation
+    const auto propagationStart = std::chrono::steady_clock::now();
+    data.sceneGraph.update();
+    const auto propagationEnd = std::chrono::steady_clock::now();
+    std::cout << "[Model] scene graph: " << data.sceneGraph.getNumNodes()
+              << " nodes, " << data.instances.size()
+              << " mesh instances, propagation in "
+              << toMilliseconds(propagationEnd - propagationStart) << " ms"
+              << std::endl;
+    data.instanceBounds.clear();
+    data.meshBounds.assign(data.meshes.size(), Bounds());
+    for (const auto& instance : data.instances) {
+      data.instanceBounds.push_back(
+          data.sceneGraph.getWorld(instance.node)
+              .transformBounds(data.meshes[instance.mesh].bounds));
+      data.meshBounds[instance.mesh].merge(data.instanceBounds.back());
+    }
+
+    buildBVHs(data);
+    data.occluders = OcclusionCuller::selectOccluders(
+        data.meshes, data.instances, data.sceneGraph);
+    std::cout << "[Model] occluders: " << data.occluders.nMeshes
+              << " meshes, " << data.occluders.indices.size() / 3
+              << " triangles" << std::endl;
+    status.value = 0.7f;
+
+    if (!decodeTextures(data, status)) {
+      return std::nullopt;
+    }
+    buildTextureArrays(data);
+
+    status.value = 1.0f;
+    return data;
+  }
+
+  // create GL resources from the loaded model, with geometry stored in given
+  // arena and textures streamed through given uploader. must be called on
+  // the thread owning the GL context, which waits while worker threads copy
+  // the decoded pixels into the uploader's ring.
+  void upload(ModelData&& data, GeometryArena& arena,
+              TextureUploader& textureUploader) {
+    geometryArena = &arena;
+    vertexFormat = data.options.vertexFormat;
+    const auto uploadStart = std::chrono::steady_clock::now();
+    for (const auto& layout : data.textureArrays) {
+      textureArrays.emplace_back();
+      textureArrays.back().allocate(layout.width, layout.height,
+                                    layout.layers);
+    }
+    textureUploader.upload(textureArrays, data.textureLayers, data.textures);
+
+    for (auto& mesh : data.meshes) {
+      meshes.emplace_back(std::move(mesh), arena, data.options.vertexFormat,
+                          data.options.keepCPUData);
+      setTextureLayers(meshes.back(), data);
+      meshes.back().nInstances = 0;
+    }
+    sceneGraph = std::move(data.sceneGraph);
+    instances = std::move(data.instances);
+    for (std::uint32_t i = 0; i < instances.size(); ++i) {
+      Mesh& mesh = meshes[instances[i].mesh];
+      if (mesh.nInstances++ == 0) mesh.firstInstance = i;
+    }
+    buildNodeInstances();
+    uploadTransforms();
+    instanceBounds = std::move(data.instanceBounds);
+    meshBounds = std::move(data.meshBounds);
+    frustumCuller.setBounds(meshBounds);
+    modelBounds = Bounds();
+    for (const auto& bounds : meshBounds) {
+      modelBounds.merge(bounds);
+    }
+    clearCulling();
+    meshBVH = std::move(data.meshBVH);
+    triangleBVHs = std::move(data.triangleBVHs);
+    occlusionCuller.setOccluders(std::move(data.occluders));
+    setupMaterials();
+    setupMultiDraw();
+    const auto uploadEnd = std::chrono::steady_clock::now();
+
+    // release CPU copies before measuring memory usage
+    data.meshes.clear();
+    data.meshes.shrink_to_fit();
+    const std::size_t nTextures = data.textures.size();
+    data.textures.clear();
+    data.textures.shrink_to_fit();
+    data.cacheFile.reset();
+    const MemoryUsage memoryUsage = MemoryUsage::get();
 
     // show info
-    std::cout << "[Model] " << filepath << " loaded." << std::endl;
+    std::cout << "[Model] " << data.filepath << " loaded." << std::endl;
     std::cout << "[Model] number of meshes: " << meshes.size() << std::endl;
 
     std::size_t nVertices = 0;
     std::size_t nFaces = 0;
+    std::size_t nInstances = 0;
+    std::size_t nInstancedFaces = 0;
+    std::size_t n16BitMeshes = 0;
+    std::size_t indexMemory = 0;
     for (std::size_t i = 0; i < meshes.size(); ++i) {
-      nVertices += meshes[i].vertices.size();
-      nFaces += meshes[i].indices.size() / 3;
+      nVertices += meshes[i].getNumVertices();
+      nFaces += meshes[i].getNumIndices() / 3;
+      nInstances += meshes[i].nInstances;
+      nInstancedFaces += meshes[i].nInstances * meshes[i].getNumIndices() / 3;
+      if (meshes[i].getIndexType() == GL_UNSIGNED_SHORT) n16BitMeshes++;
+      indexMemory += meshes[i].getNumIndices() * meshes[i].getIndexSize();
     }
     std::cout << "[Model] number of vertices: " << nVertices << std::endl;
+    const std::size_t vertexSize =
+        VertexPacker::getVertexSize(data.options.vertexFormat);
+    std::cout << "[Model] vertex format: "
+              << VertexPacker::getName(data.options.vertexFormat) << ", "
+              << vertexSize << " bytes per vertex, "
+              << MemoryUsage::toMegabytes(nVertices * vertexSize)
+              << " MB (float layout "
+              << MemoryUsage::toMegabytes(nVertices * sizeof(Vertex))
+              << " MB)" << std::endl;
     std::cout << "[Model] number of faces: " << nFaces << std::endl;
-    std::cout << "[Model] number of textures: " << textures.size() << std::endl;
+    std::cout << "[Model] number of instances: " << nInstances << " ("
+              << nInstancedFaces << " faces drawn)" << std::endl;
+    std::cout << "[Model] 16-bit index buffers: " << n16BitMeshes << " of "
+              << meshes.size() << " meshes, "
+              << MemoryUsage::toMegabytes(indexMemory) << " MB (32-bit "
+              << MemoryUsage::toMegabytes(3 * nFaces * sizeof(unsigned int))
+              << " MB)" << std::endl;
+    std::cout << "[Model] number of textures: " << nTextures << " in "
+              << textureArrays.size() << " texture arrays" << std::endl;
+    std::cout << "[Model] number of materials: " << nMaterials << " in "
+              << materialBuffer.getNumWindows() << " uniform buffer windows"
+              << std::endl;
+    std::cout << "[Model] GL upload: "
+              << toMilliseconds(uploadEnd - uploadStart) << " ms" << std::endl;
+    arena.printStatistics();
+    std::cout << "[Model] RSS: "
+              << MemoryUsage::toMegabytes(memoryUsage.rss) << " MB (peak "
+              << MemoryUsage::toMegabytes(memoryUsage.peakRSS) << " MB, "
+              << (data.options.keepCPUData ? "CPU mesh data kept"
+                                           : "CPU mesh data released")
+              << ")" << std::endl;
   }
 
-  // draw model by given shader
-  void draw(const Shader& shader) const {
-    for (std::size_t i = 0; i < meshes.size(); i++) {
-      meshes[i].draw(shader, textures);
+  // draw meshes left visible by the last cull() by given shader. with
+  // multiDraw, meshes sharing textures and index type are submitted by one
+  // glMultiDrawElementsIndirect. meshes are drawn in the order of the last
+  // buildDrawList(). returns number of draw calls.
+  std::size_t draw(const Shader& shader, bool multiDraw = false) {
+    if (!geometryArena) return 0;
+
+    // every mesh shares the VAO of the arena
+    geometryArena->bind(vertexFormat);
+    transformBuffer.setVisibleInstances(visibleInstances);
+    transformBuffer.bind();
+    materialBuffer.invalidateBinding();
+    std::size_t nDrawCalls = 0;
+    if (multiDraw && MultiDrawIndirect::isSupported()) {
+      nDrawCalls = drawIndirect(shader);
+    } else {
+      for (const std::uint32_t i : drawList) {
+        materialBuffer.bindWindow(
+            MaterialBuffer::getWindow(meshes[i].materialIndex));
+        meshes[i].draw(shader, textureArrays);
+        nDrawCalls++;
+      }
     }
+    shader.deactivate();
+    glBindVertexArray(0);
+    return nDrawCalls;
+  }
+
+  // list meshes left visible by culling for draw(). sorted lists are
+  // ordered by draw group, material and front-to-back depth from given
+  // camera, so that state changes are rare and early depth testing rejects
+  // hidden fragments. unsorted lists keep the order of the scene.
+  void buildDrawList(const glm::vec3& cameraPosition,
+                     const glm::vec3& cameraForward, bool sorted) {
+    drawList.clear();
+    if (!sorted) {
+      for (std::size_t i = 0; i < meshes.size(); ++i) {
+        if (visible[i]) drawList.push_back(i);
+      }
+      return;
+    }
+
+    // depth of the nearest point of bounding spheres, quantized over the
+    // depth range of the model
+    const float maxDepth =
+        glm::length(modelBounds.center - cameraPosition) + modelBounds.radius;
+    const float depthScale =
+        maxDepth > 0.0f ? static_cast<float>(DEPTH_MASK) / maxDepth : 0.0f;
+
+    drawKeys.clear();
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+      if (!visible[i]) continue;
+      const Bounds& bounds = meshBounds[i];
+      const float depth = std::clamp(
+          glm::dot(bounds.center - cameraPosition, cameraForward) -
+              bounds.radius,
+          0.0f, maxDepth);
+      const std::uint64_t key =
+          static_cast<std::uint64_t>(std::min(drawGroups[i], GROUP_MASK))
+              << GROUP_SHIFT |
+          static_cast<std::uint64_t>(
+              std::min(meshes[i].materialIndex, MATERIAL_MASK))
+              << MATERIAL_SHIFT |
+          static_cast<std::uint64_t>(
+              std::min(static_cast<std::uint32_t>(depth * depthScale),
+                       DEPTH_MASK))
+              << DEPTH_SHIFT;
+      drawKeys.push_back(key);
+      drawList.push_back(i);
+    }
+    radixSort.sort(drawKeys, drawList);
+  }
+
+  // local transform of given scene graph node
+  glm::mat4 getNodeTransform(std::uint32_t node) const {
+    return sceneGraph.getLocals()[node].toMatrix();
+  }
+
+  // set local transform of given scene graph node, applied by the next
+  // updateTransforms()
+  void setNodeTransform(std::uint32_t node, const glm::mat4& local) {
+    sceneGraph.setLocal(node, AffineTransform::fromMatrix(local));
+  }
+
+  // recompute world transforms of changed nodes and refit what depends on
+  // them: transforms and bounds of the instances below those nodes, bounds
+  // of their meshes in the culler and the mesh BVH, and the occluders.
+  // returns whether anything changed.
+  bool updateTransforms() {
+    if (!sceneGraph.update()) return false;
+
+    // instances of a node range are contiguous in nodeInstances
+    std::vector<std::uint32_t> changedInstances;
+    for (const auto& [first, end] : sceneGraph.getUpdatedRanges()) {
+      changedInstances.insert(
+          changedInstances.end(),
+          nodeInstances.begin() + nodeInstanceStarts[first],
+          nodeInstances.begin() + nodeInstanceStarts[end]);
+    }
+    if (changedInstances.empty()) return false;
+
+    // instances are grouped by mesh, so sorted instances give sorted meshes
+    std::sort(changedInstances.begin(), changedInstances.end());
+    std::vector<std::uint32_t> changedMeshes;
+    for (const std::uint32_t i : changedInstances) {
+      const MeshInstance& instance = instances[i];
+      const AffineTransform& world = sceneGraph.getWorld(instance.node);
+      instanceTransforms[i] = InstanceTransform::fromWorld(world);
+      instanceBounds[i] =
+          world.transformBounds(meshes[instance.mesh].getBounds());
+      if (changedMeshes.empty() || changedMeshes.back() != instance.mesh) {
+        changedMeshes.push_back(instance.mesh);
+      }
+    }
+    transformBuffer.setTransforms(instanceTransforms);
+
+    for (const std::uint32_t m : changedMeshes) {
+      const Mesh& mesh = meshes[m];
+      meshBounds[m] = Bounds();
+      for (std::uint32_t i = mesh.firstInstance;
+           i < mesh.firstInstance + mesh.nInstances; ++i) {
+        meshBounds[m].merge(instanceBounds[i]);
+      }
+      frustumCuller.updateBounds(m, meshBounds[m]);
+    }
+    meshBVH.refit(meshBounds, changedMeshes);
+    const BVH::Node& root = meshBVH.getNodes()[0];
+    modelBounds = Bounds::fromBox(root.min, root.max);
+
+    occlusionCuller.updateTransforms(sceneGraph);
+    return true;
+  }
+
+  const SceneGraph& getSceneGraph() const { return sceneGraph; }
+
+  // mark meshes outside of given view frustum as invisible, either by
+  // testing every mesh or by traversing the mesh BVH. the bounds of a mesh
+  // drawn several times enclose all of its instances, so the instances of
+  // a visible mesh are tested one by one and only visible ones are drawn.
+  // returns number of visible meshes.
+  std::size_t cull(const glm::mat4& viewProjection, bool hierarchical) {
+    const Frustum frustum = Frustum::fromMatrix(viewProjection);
+    std::size_t nVisible = hierarchical
+                               ? meshBVH.cull(frustum, meshBounds, visible)
+                               : frustumCuller.cull(frustum, visible);
+
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+      Mesh& mesh = meshes[i];
+      mesh.nVisibleInstances = 0;
+      if (!visible[i]) continue;
+      for (std::uint32_t k = mesh.firstInstance;
+           k < mesh.firstInstance + mesh.nInstances; ++k) {
+        // a single instance has the bounds of its mesh
+        if (mesh.nInstances == 1 || frustum.intersects(instanceBounds[k])) {
+          visibleInstances[mesh.firstInstance + mesh.nVisibleInstances++] =
+              k;
+        }
+      }
+      if (mesh.nVisibleInstances == 0) {
+        visible[i] = 0;
+        nVisible--;
+      }
+    }
+    return nVisible;
+  }
+
+  // mark visible instances hidden behind occluders as invisible, and meshes
+  // whose instances are all hidden. aspect is the aspect ratio of the
+  // viewport. returns number of meshes culled.
+  std::size_t cullOccluded(const glm::mat4& viewProjection, float aspect) {
+    occlusionCuller.setAspectRatio(aspect);
+    occlusionCuller.render(viewProjection);
+
+    std::size_t nOccluded = 0;
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+      if (!visible[i]) continue;
+      Mesh& mesh = meshes[i];
+      std::uint32_t* slots = &visibleInstances[mesh.firstInstance];
+      std::uint32_t nVisible = 0;
+      for (std::uint32_t j = 0; j < mesh.nVisibleInstances; ++j) {
+        if (!occlusionCuller.isOccluded(instanceBounds[slots[j]],
+                                        viewProjection)) {
+          slots[nVisible++] = slots[j];
+        }
+      }
+      mesh.nVisibleInstances = nVisible;
+      if (nVisible == 0) {
+        visible[i] = 0;
+        nOccluded++;
+      }
+    }
+    return nOccluded;
+  }
+
+  // find closest mesh hit by given ray. meshes whose CPU data was kept are
+  // tested by triangle, others by their bounds.
+  std::optional<RayHit> raycast(const glm::vec3& origin,
+                                const glm::vec3& direction) const {
+    float tMax = std::numeric_limits<float>::max();
+    bool exact = false;
+    const std::optional<std::uint32_t> meshIndex = meshBVH.intersect(
+        origin, direction, tMax, [&](std::uint32_t i, float& t) {
+          const std::optional<float> tMesh =
+              intersectMesh(i, origin, direction, t);
+          if (!tMesh) return false;
+          t = tMesh.value();
+          exact = !triangleBVHs.empty() && !triangleBVHs[i].empty();
+          return true;
+        });
+    if (!meshIndex) return std::nullopt;
+    return RayHit{meshIndex.value(), tMax, exact};
+  }
+
+  // mark all meshes and instances as visible
+  void clearCulling() {
+    visible.assign(meshes.size(), 1);
+    for (auto& mesh : meshes) {
+      mesh.nVisibleInstances = mesh.nInstances;
+    }
+    visibleInstances.resize(instances.size());
+    std::iota(visibleInstances.begin(), visibleInstances.end(), 0);
+  }
+
+  std::size_t getNumMeshes() const { return meshes.size(); }
+  std::size_t getNumInstances() const { return instances.size(); }
+
+  // number of instances left visible by the last culling
+  std::size_t getNumVisibleInstances() const {
+    std::size_t nVisible = 0;
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+      if (visible[i]) nVisible += meshes[i].nVisibleInstances;
+    }
+    return nVisible;
   }
 
   void destroy() {
     for (auto& mesh : meshes) {
-      mesh.destroy();
+      mesh.destroy(*geometryArena);
     }
     meshes.clear();
+    sceneGraph.clear();
+    instances.clear();
+    nodeInstanceStarts.clear();
+    nodeInstances.clear();
+    instanceTransforms.clear();
+    transformBuffer.destroy();
+    instanceBounds.clear();
+    meshBounds.clear();
+    modelBounds = Bounds();
+    frustumCuller.setBounds({});
+    visible.clear();
+    visibleInstances.clear();
+    meshBVH = BVH();
+    triangleBVHs.clear();
+    occlusionCuller.setOccluders(Occluders());
+    multiDrawIndirect.destroy();
+    materialBuffer.destroy();
+    nMaterials = 0;
+    drawList.clear();
+    drawKeys.clear();
+    drawGroups.clear();
 
-    for (auto& texture : textures) {
-      texture.destroy();
+    for (auto& textureArray : textureArrays) {
+      textureArray.destroy();
     }
-    textures.clear();
+    textureArrays.clear();
   }
 
  private:
+  GeometryArena* geometryArena = nullptr;  // where geometry of meshes lives
+  VertexFormat vertexFormat = VertexFormat::Float;
   std::vector<Mesh> meshes;
-  std::vector<Texture> textures;
+  std::vector<TextureArray> textureArrays;
+  SceneGraph sceneGraph;
+  std::vector<MeshInstance> instances;  // grouped by mesh
+  // instances of node n are nodeInstances[nodeInstanceStarts[n],
+  // nodeInstanceStarts[n + 1])
+  std::vector<std::uint32_t> nodeInstanceStarts;
+  std::vector<std::uint32_t> nodeInstances;
+  std::vector<InstanceTransform> instanceTransforms;
+  TransformBuffer transformBuffer;     // instanceTransforms on the GPU
+  std::vector<Bounds> instanceBounds;  // in world space
+  std::vector<Bounds> meshBounds;      // in world space, over instances
+  FrustumCuller frustumCuller;
+  std::vector<unsigned char> visible;  // result of last cull, per mesh
+  // result of last cull per instance slot, see TransformBuffer
+  std::vector<std::uint32_t> visibleInstances;
+  BVH meshBVH;
+  std::vector<BVH> triangleBVHs;  // empty unless CPU data was kept
+  OcclusionCuller occlusionCuller;
+  MaterialBuffer materialBuffer;
+  std::size_t nMaterials = 0;
+  MultiDrawIndirect multiDrawIndirect;
+  Bounds modelBounds;                     // of every mesh
+  std::vector<std::uint32_t> drawGroups;  // draw group of each mesh
+  std::vector<std::uint32_t> drawList;    // meshes to draw this frame
+  std::vector<std::uint64_t> drawKeys;    // sort keys of drawList
+  RadixSort radixSort;
+  std::vector<DrawElementsIndirectCommand> drawCommands;  // of this frame
+
+  using TextureReference = std::pair<std::string, TextureType>;
+
+  // layout of draw sort keys, from most to least significant: draw group,
+  // material index and quantized depth. every draw of a frame uses the same
+  // program and VAO, so they need no bits.
+  static constexpr unsigned int GROUP_SHIFT = 48;
+  static constexpr std::uint32_t GROUP_MASK = (1u << 16) - 1;
+  static constexpr unsigned int MATERIAL_SHIFT = 32;
+  static constexpr std::uint32_t MATERIAL_MASK = (1u << 16) - 1;
+  static constexpr unsigned int DEPTH_SHIFT = 8;
+  static constexpr std::uint32_t DEPTH_MASK = (1u << 24) - 1;
+
+  // TextureResizePolicy::Outliers resizes a texture when its size is
+  // shared by at most this many other textures
+  static constexpr std::size_t MAX_OUTLIER_SHARES = 2;
+
+  // forwards assimp's import progress and aborts import when cancelled
+  class ImportProgressHandler : public Assimp::ProgressHandler {
+   public:
+    ImportProgressHandler(LoadProgress& progress) : progress(progress) {}
+
+    bool Update(float percentage) override {
+      if (percentage >= 0.0f) {
+        progress.value = 0.5f * percentage;
+      }
+      return !progress.cancelled;
+    }
+
+   private:
+    LoadProgress& progress;
+  };
+
+  // records the files assimp opens, such as .mtl files next to the model,
+  // so that the mesh cache can key entries on them
+  class RecordingIOSystem : public Assimp::DefaultIOSystem {
+   public:
+    RecordingIOSystem(std::vector<std::string>& files) : files(files) {}
+
+    Assimp::IOStream* Open(const char* file, const char* mode) override {
+      files.emplace_back(file);
+      return DefaultIOSystem::Open(file, mode);
+    }
+
+   private:
+    std::vector<std::string>& files;
+  };
+
+  static constexpr unsigned int IMPORT_FLAGS =
+      aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals;
+
+  // identifies settings which change the converted meshes
+  static std::uint64_t getCacheFlags(const std::string& filepath,
+                                     const LoadOptions& options) {
+    std::uint64_t flags = IMPORT_FLAGS;
+    if (options.optimizeMeshes) flags |= std::uint64_t(1) << 32;
+    if (options.splitMeshes) flags |= std::uint64_t(1) << 33;
+    if (options.nativeLoaders && hasNativeLoader(filepath)) {
+      flags |= std::uint64_t(1) << 34;
+    }
+    return flags;
+  }
+
+  // load model with assimp and convert meshes into data
+  static bool importScene(const std::string& filepath,
+                          const LoadOptions& options, ModelData& data,
+                          LoadProgress& status) {
+    // load model with assimp
+    Assimp::Importer importer;
+    importer.SetProgressHandler(new ImportProgressHandler(status));
+    importer.SetIOHandler(new RecordingIOSystem(data.sideFiles));
+    const aiScene* scene = importer.ReadFile(filepath, IMPORT_FLAGS);
+
+    if (status.cancelled) {
+      return false;
+    }
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE ||
+        !scene->mRootNode) {
+      std::cerr << "[Assimp] " << importer.GetErrorString() << std::endl;
+      return false;
+    }
+
+    // collect meshes in scene graph order. meshes referenced by several
+    // nodes are converted once and drawn instanced.
+    std::vector<unsigned int> meshIndices;
+    std::vector<std::vector<std::uint32_t>> meshNodes(scene->mNumMeshes);
+    processNode(scene->mRootNode, SceneGraph::NO_PARENT, data.sceneGraph,
+                meshIndices, meshNodes);
+    std::vector<const aiMesh*> aiMeshes;
+    for (const unsigned int index : meshIndices) {
+      aiMeshes.push_back(scene->mMeshes[index]);
+    }
+
+    // convert meshes on worker threads
+    const auto convertStart = std::chrono::steady_clock::now();
+    const std::filesystem::path ps(filepath);
+    const std::string parentPath = ps.parent_path();
+    std::vector<MeshData> converted(aiMeshes.size());
+    std::vector<std::vector<TextureReference>> textureReferences(
+        aiMeshes.size());
+    std::atomic<std::size_t> nConverted{0};
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(aiMeshes.size(), [&](std::size_t i) {
+      if (status.cancelled) return;
+      converted[i] =
+          processMesh(aiMeshes[i], scene, parentPath, textureReferences[i]);
+      status.value = 0.5f + 0.1f * (nConverted.fetch_add(1) + 1) /
+                                aiMeshes.size();
+    });
+    const auto convertEnd = std::chrono::steady_clock::now();
+
+    if (status.cancelled) {
+      return false;
+    }
+
+    // show info
+    std::cout << "[Model] mesh conversion: "
+              << toMilliseconds(convertEnd - convertStart) << " ms ("
+              << pool.getNumThreads() << " threads, "
+              << std::thread::hardware_concurrency() << " cores)" << std::endl;
+    std::vector<std::vector<std::uint32_t>> nodesOfMeshes(aiMeshes.size());
+    std::size_t nMeshReferences = 0;
+    for (std::size_t i = 0; i < aiMeshes.size(); ++i) {
+      nodesOfMeshes[i] = std::move(meshNodes[meshIndices[i]]);
+      nMeshReferences += nodesOfMeshes[i].size();
+    }
+    std::cout << "[Model] mesh references: " << nMeshReferences << " to "
+              << aiMeshes.size() << " meshes" << std::endl;
+
+    return addMeshes(converted, textureReferences, nodesOfMeshes, options,
+                     data, status);
+  }
+
+  static bool hasNativeLoader(const std::string& filepath) {
+    return NativeLoader::hasExtension(filepath, ".obj") ||
+           NativeLoader::hasExtension(filepath, ".ply") ||
+           NativeLoader::hasExtension(filepath, ".stl");
+  }
+
+  // load OBJ, PLY or STL file with its native loader and convert meshes into
+  // data. returns false when the file is rejected.
+  static bool importNative(const std::string& filepath,
+                           const LoadOptions& options, ModelData& data,
+                           LoadProgress& status) {
+    const auto loadStart = std::chrono::steady_clock::now();
+    std::optional<ObjLoader::Result> result;
+    if (NativeLoader::hasExtension(filepath, ".obj")) {
+      result = ObjLoader::load(filepath, status.value, status.cancelled);
+    } else {
+      std::optional<MeshData> mesh =
+          NativeLoader::hasExtension(filepath, ".ply")
+              ? PlyLoader::load(filepath, status.value, status.cancelled)
+              : StlLoader::load(filepath, status.value, status.cancelled);
+      if (mesh) {
+        result.emplace();
+        result->meshes.push_back(std::move(*mesh));
+        result->textureReferences.emplace_back();
+      }
+    }
+    if (!result) {
+      return false;
+    }
+    data.sideFiles = std::move(result->materialLibraries);
+    const auto loadEnd = std::chrono::steady_clock::now();
+    std::size_t nVertices = 0, nTriangles = 0;
+    for (const auto& mesh : result->meshes) {
+      nVertices += mesh.vertexCount();
+      nTriangles += mesh.indexCount() / 3;
+    }
+    std::cout << "[Model] native loader: " << filepath << " in "
+              << toMilliseconds(loadEnd - loadStart) << " ms ("
+              << ThreadPool::shared().getNumThreads() << " threads), "
+              << nVertices << " vertices, " << nTriangles << " triangles"
+              << std::endl;
+
+    // these formats have no node hierarchy, so every mesh is drawn once at
+    // the root
+    data.sceneGraph.addNode(SceneGraph::NO_PARENT, AffineTransform());
+    const std::vector<std::vector<std::uint32_t>> meshNodes(
+        result->meshes.size(), std::vector<std::uint32_t>(1, 0));
+    return addMeshes(result->meshes, result->textureReferences, meshNodes,
+                     options, data, status);
+  }
+
+  // optimize and split converted meshes on worker threads, then add them to
+  // data with their textures and an instance at each of given nodes
+  static bool addMeshes(
+      std::vector<MeshData>& meshes,
+      const std::vector<std::vector<TextureReference>>& textureReferences,
+      const std::vector<std::vector<std::uint32_t>>& meshNodes,
+      const LoadOptions& options, ModelData& data, LoadProgress& status) {
+    const auto optimizeStart = std::chrono::steady_clock::now();
+    std::vector<std::vector<MeshData>> converted(meshes.size());
+    std::vector<MeshOptimizer::Statistics> optimizerStatistics(
+        meshes.size());
+    std::atomic<std::size_t> nOptimized{0};
+    ThreadPool::shared().parallelFor(meshes.size(), [&](std::size_t i) {
+      if (status.cancelled) return;
+      MeshData& mesh = meshes[i];
+      if (options.optimizeMeshes) {
+        optimizerStatistics[i] =
+            MeshOptimizer::optimize(mesh.vertices, mesh.indices);
+      }
+      if (options.splitMeshes) {
+        converted[i] = MeshOptimizer::split(std::move(mesh));
+      } else {
+        converted[i].push_back(std::move(mesh));
+      }
+      status.value = 0.6f + 0.1f * (nOptimized.fetch_add(1) + 1) /
+                                meshes.size();
+    });
+    const auto optimizeEnd = std::chrono::steady_clock::now();
+
+    if (status.cancelled) {
+      return false;
+    }
+
+    // assign texture indices. paths are normalized by the loaders, so a
+    // hash lookup is enough to find textures referenced more than once.
+    std::unordered_map<std::string, unsigned int> textureIndices;
+    std::size_t nTextureReferences = 0;
+    std::size_t nDeduplicated = 0;
+    for (std::size_t i = 0; i < converted.size(); ++i) {
+      std::vector<unsigned int> indicesOfTextures;
+      for (const auto& [texturePath, textureType] : textureReferences[i]) {
+        const auto [it, inserted] =
+            textureIndices.try_emplace(texturePath, data.textures.size());
+        if (inserted) {
+          data.textures.push_back({texturePath, textureType, Image()});
+        } else {
+          nDeduplicated++;
+        }
+        // add texture index
+        indicesOfTextures.push_back(it->second);
+        nTextureReferences++;
+      }
+
+      // sub-meshes keep the order of their source mesh and are drawn at
+      // every node referencing it
+      for (auto& mesh : converted[i]) {
+        mesh.indicesOfTextures = indicesOfTextures;
+        const std::uint32_t meshIndex = data.meshes.size();
+        for (const std::uint32_t node : meshNodes[i]) {
+          data.instances.push_back({meshIndex, node});
+        }
+        data.meshes.push_back(std::move(mesh));
+      }
+    }
+    deduplicateMeshes(data);
+
+    // show info
+    if (options.optimizeMeshes || options.splitMeshes) {
+      std::cout << "[Model] mesh optimization: "
+                << toMilliseconds(optimizeEnd - optimizeStart) << " ms"
+                << std::endl;
+    }
+    std::cout << "[Model] texture references: " << nTextureReferences << " ("
+              << nDeduplicated << " deduplicated)" << std::endl;
+    if (options.optimizeMeshes) {
+      printOptimizerStatistics(optimizerStatistics);
+    }
+
+    return true;
+  }
+
+  // merge meshes with identical geometry, material and textures into one
+  // mesh drawn at the nodes of all of them, whether or not the scene shares
+  // them. meshes are hashed on worker threads, and equal hashes are
+  // confirmed by comparing the data.
+  static void deduplicateMeshes(ModelData& data) {
+    const auto dedupStart = std::chrono::steady_clock::now();
+    const std::size_t nMeshes = data.meshes.size();
+    std::vector<std::uint64_t> hashes(nMeshes);
+    ThreadPool::shared().parallelFor(nMeshes, [&](std::size_t i) {
+      const MeshData& mesh = data.meshes[i];
+      std::uint64_t hash = ContentHash::hash(
+          mesh.vertexData(), mesh.vertexCount() * sizeof(Vertex));
+      hash = ContentHash::hash(mesh.indexData(),
+                               mesh.indexCount() * sizeof(unsigned int), hash);
+      hash = ContentHash::hash(&mesh.material, sizeof(Material), hash);
+      hashes[i] = ContentHash::hash(
+          mesh.indicesOfTextures.data(),
+          mesh.indicesOfTextures.size() * sizeof(unsigned int), hash);
+    });
+
+    // keep the first mesh of each content
+    std::unordered_multimap<std::uint64_t, std::uint32_t> uniqueIndices;
+    std::vector<MeshData> uniqueMeshes;
+    std::vector<std::uint32_t> remap(nMeshes);
+    std::size_t bytesSaved = 0;
+    for (std::size_t i = 0; i < nMeshes; ++i) {
+      MeshData& mesh = data.meshes[i];
+      const auto [first, last] = uniqueIndices.equal_range(hashes[i]);
+      const auto it = std::find_if(first, last, [&](const auto& entry) {
+        return isSameMesh(uniqueMeshes[entry.second], mesh);
+      });
+      if (it != last) {
+        remap[i] = it->second;
+        bytesSaved += mesh.vertexCount() * sizeof(Vertex) +
+                      mesh.indexCount() * sizeof(unsigned int);
+        continue;
+      }
+      remap[i] = uniqueMeshes.size();
+      uniqueIndices.emplace(hashes[i], uniqueMeshes.size());
+      uniqueMeshes.push_back(std::move(mesh));
+    }
+
+    // instances of merged meshes move to the mesh kept, staying grouped by
+    // mesh
+    for (auto& instance : data.instances) {
+      instance.mesh = remap[instance.mesh];
+    }
+    std::stable_sort(data.instances.begin(), data.instances.end(),
+                     [](const MeshInstance& a, const MeshInstance& b) {
+                       return a.mesh < b.mesh;
+                     });
+    data.meshes = std::move(uniqueMeshes);
+    const auto dedupEnd = std::chrono::steady_clock::now();
+
+    // show info
+    std::cout << "[Model] geometry deduplication: " << nMeshes
+              << " meshes merged into " << data.meshes.size() << ", "
+              << MemoryUsage::toMegabytes(bytesSaved) << " MB saved in "
+              << toMilliseconds(dedupEnd - dedupStart) << " ms" << std::endl;
+  }
+
+  // whether meshes have byte-identical geometry, material and textures
+  static bool isSameMesh(const MeshData& a, const MeshData& b) {
+    const auto sameBytes = [](const void* x, const void* y, std::size_t n) {
+      return n == 0 || std::memcmp(x, y, n) == 0;
+    };
+    return a.vertexCount() == b.vertexCount() &&
+           a.indexCount() == b.indexCount() &&
+           a.indicesOfTextures == b.indicesOfTextures &&
+           sameBytes(&a.material, &b.material, sizeof(Material)) &&
+           sameBytes(a.vertexData(), b.vertexData(),
+                     a.vertexCount() * sizeof(Vertex)) &&
+           sameBytes(a.indexData(), b.indexData(),
+                     a.indexCount() * sizeof(unsigned int));
+  }
+
+  // show ACMR weighted by triangles and ATVR weighted by vertices
+  static void printOptimizerStatistics(
+      const std::vector<MeshOptimizer::Statistics>& statistics) {
+    double nTriangles = 0.0;
+    double nVertices = 0.0;
+    VertexCacheStatistics before, after;
+    for (std::size_t i = 0; i < statistics.size(); ++i) {
+      const double t = statistics[i].nTriangles;
+      const double v = statistics[i].nVertices;
+      before.acmr += t * statistics[i].before.acmr;
+      before.atvr += v * statistics[i].before.atvr;
+      after.acmr += t * statistics[i].after.acmr;
+      after.atvr += v * statistics[i].after.atvr;
+      nTriangles += t;
+      nVertices += v;
+    }
+    if (nTriangles == 0.0 || nVertices == 0.0) return;
+
+    std::cout << "[MeshOptimizer] ACMR: " << before.acmr / nTriangles << " -> "
+              << after.acmr / nTriangles << std::endl;
+    std::cout << "[MeshOptimizer] ATVR: " << before.atvr / nVertices << " -> "
+              << after.atvr / nVertices << std::endl;
+  }
+
+  // build BVH over world bounds of meshes and, when CPU data is kept for ray
+  // queries, over the triangles of every mesh in mesh space
+  static void buildBVHs(ModelData& data) {
+    const auto buildStart = std::chrono::steady_clock::now();
+    data.meshBVH.build(data.meshBounds);
+
+    std::size_t nTriangleNodes = 0;
+    if (data.options.keepCPUData) {
+      data.triangleBVHs.resize(data.meshes.size());
+      ThreadPool::shared().parallelFor(data.meshes.size(), [&](std::size_t i) {
+        const MeshData& mesh = data.meshes[i];
+        const Vertex* vertices = mesh.vertexData();
+        const unsigned int* indices = mesh.indexData();
+        std::vector<Bounds> triangles(mesh.indexCount() / 3);
+        for (std::size_t t = 0; t < triangles.size(); ++t) {
+          const glm::vec3& p0 = vertices[indices[3 * t + 0]].position;
+          const glm::vec3& p1 = vertices[indices[3 * t + 1]].position;
+          const glm::vec3& p2 = vertices[indices[3 * t + 2]].position;
+          triangles[t] = Bounds::fromBox(glm::min(p0, glm::min(p1, p2)),
+                                         glm::max(p0, glm::max(p1, p2)));
+        }
+        data.triangleBVHs[i].build(triangles);
+      });
+      for (const auto& bvh : data.triangleBVHs) {
+        nTriangleNodes += bvh.getNumNodes();
+      }
+    }
+    const auto buildEnd = std::chrono::steady_clock::now();
+
+    // show info
+    std::cout << "[Model] BVH build: " << toMilliseconds(buildEnd - buildStart)
+              << " ms (" << data.meshBVH.getNumNodes() << " nodes over "
+              << data.meshes.size() << " meshes";
+    if (data.options.keepCPUData) {
+      std::cout << ", " << nTriangleNodes << " nodes over triangles";
+    }
+    std::cout << ")" << std::endl;
+  }
+
+  // closest hit of ray with mesh i before tMax
+  std::optional<float> intersectMesh(std::size_t i, const glm::vec3& origin,
+                                     const glm::vec3& direction,
+                                     float tMax) const {
+    const std::optional<MeshData>& data = meshes[i].getData();
+    if (triangleBVHs.empty() || triangleBVHs[i].empty() || !data) {
+      BVH::Node box;
+      box.min = meshBounds[i].min;
+      box.max = meshBounds[i].max;
+      return BVH::intersectBox(box, origin, 1.0f / direction, tMax);
+    }
+
+    // instances are tested in mesh space. an affine transform keeps the
+    // parametrization of the ray, so distances of all instances compare.
+    const Vertex* vertices = data->vertexData();
+    const unsigned int* indices = data->indexData();
+    const Mesh& mesh = meshes[i];
+    bool hit = false;
+    for (std::uint32_t k = mesh.firstInstance;
+         k < mesh.firstInstance + mesh.nInstances; ++k) {
+      const glm::mat4 inverse =
+          glm::inverse(sceneGraph.getWorld(instances[k].node).toMatrix());
+      const glm::vec3 meshOrigin(inverse * glm::vec4(origin, 1.0f));
+      const glm::vec3 meshDirection(inverse * glm::vec4(direction, 0.0f));
+      const auto intersectTriangle = [&](std::uint32_t t, float& tTriangle) {
+        const std::optional<float> d = BVH::intersectTriangle(
+            meshOrigin, meshDirection, vertices[indices[3 * t + 0]].position,
+            vertices[indices[3 * t + 1]].position,
+            vertices[indices[3 * t + 2]].position);
+        if (!d || d.value() >= tTriangle) return false;
+        tTriangle = d.value();
+        return true;
+      };
+      if (triangleBVHs[i].intersect(meshOrigin, meshDirection, tMax,
+                                    intersectTriangle)) {
+        hit = true;
+      }
+    }
+    if (!hit) return std::nullopt;
+    return tMax;
+  }
+
+  // index instances by node, so that a moved subtree finds its instances
+  void buildNodeInstances() {
+    const std::size_t nNodes = sceneGraph.getNumNodes();
+    nodeInstanceStarts.assign(nNodes + 1, 0);
+    for (const auto& instance : instances) {
+      nodeInstanceStarts[instance.node + 1]++;
+    }
+    for (std::size_t node = 0; node < nNodes; ++node) {
+      nodeInstanceStarts[node + 1] += nodeInstanceStarts[node];
+    }
+    std::vector<std::uint32_t> next(nodeInstanceStarts.begin(),
+                                    nodeInstanceStarts.end() - 1);
+    nodeInstances.resize(instances.size());
+    for (std::uint32_t i = 0; i < instances.size(); ++i) {
+      nodeInstances[next[instances[i].node]++] = i;
+    }
+  }
+
+  // upload world transforms of every instance and their normal matrices to
+  // the transform buffer
+  void uploadTransforms() {
+    instanceTransforms.clear();
+    instanceTransforms.reserve(instances.size());
+    for (const auto& instance : instances) {
+      instanceTransforms.push_back(
+          InstanceTransform::fromWorld(sceneGraph.getWorld(instance.node)));
+    }
+    transformBuffer.setTransforms(instanceTransforms);
+  }
+
+  // pack distinct materials of meshes into the material buffer
+  void setupMaterials() {
+    std::vector<MaterialBlockEntry> materials;
+    using Key = std::array<float, sizeof(MaterialBlockEntry) / sizeof(float)>;
+    std::map<Key, std::uint32_t> indices;
+    for (auto& mesh : meshes) {
+      const MaterialBlockEntry entry = mesh.getMaterialBlockEntry();
+      Key key;
+      std::memcpy(key.data(), &entry, sizeof(MaterialBlockEntry));
+      const auto it = indices.emplace(key, materials.size());
+      if (it.second) materials.push_back(entry);
+      mesh.materialIndex = it.first->second;
+    }
+    materialBuffer.setMaterials(materials);
+    nMaterials = materials.size();
+  }
+
+  // upload per-draw data of every mesh and group meshes sharing texture
+  // arrays, index type and material window, which can be submitted together.
+  // groups are numbered in order of their state, so that sorting by group
+  // also sorts by texture arrays.
+  void setupMultiDraw() {
+    using GroupKey = std::tuple<std::uint32_t, std::uint32_t, GLenum,
+                                std::size_t>;
+    std::vector<GroupKey> keys;
+    std::map<GroupKey, std::uint32_t> groups;
+    for (const auto& mesh : meshes) {
+      keys.emplace_back(mesh.diffuseTexture.array, mesh.specularTexture.array,
+                        mesh.getIndexType(),
+                        MaterialBuffer::getWindow(mesh.materialIndex));
+      groups.emplace(keys.back(), 0);
+    }
+    std::uint32_t nGroups = 0;
+    for (auto& group : groups) {
+      group.second = nGroups++;
+    }
+    drawGroups.clear();
+    for (const auto& key : keys) {
+      drawGroups.push_back(groups[key]);
+    }
+
+    if (!MultiDrawIndirect::isSupported()) return;
+    std::vector<glm::vec4> drawData;
+    drawData.reserve(meshes.size() * MultiDrawIndirect::DRAW_DATA_STRIDE);
+    for (const auto& mesh : meshes) {
+      mesh.getDrawData(drawData);
+    }
+    multiDrawIndirect.setDrawData(drawData);
+    std::cout << "[Model] multi-draw groups: " << groups.size() << std::endl;
+  }
+
+  // draw visible meshes with one multi-draw per draw group. returns number
+  // of draw calls.
+  std::size_t drawIndirect(const Shader& shader) {
+    // commands of visible meshes in draw order, mesh index as draw ID
+    drawCommands.clear();
+    for (const std::uint32_t i : drawList) {
+      drawCommands.push_back(meshes[i].getDrawCommand(i));
+    }
+    if (drawCommands.empty()) return 0;
+    multiDrawIndirect.setCommands(drawCommands);
+
+    multiDrawIndirect.begin(shader);
+    std::size_t nDrawCalls = 0;
+    std::size_t first = 0;
+    while (first < drawCommands.size()) {
+      const Mesh& mesh = meshes[drawCommands[first].baseInstance];
+      const std::uint32_t group = drawGroups[drawCommands[first].baseInstance];
+      std::size_t last = first + 1;
+      while (last < drawCommands.size() &&
+             drawGroups[drawCommands[last].baseInstance] == group) {
+        last++;
+      }
+      materialBuffer.bindWindow(MaterialBuffer::getWindow(mesh.materialIndex));
+      mesh.bindTextures(textureArrays);
+      multiDrawIndirect.draw(shader, mesh.getIndexType(), first, last - first);
+      nDrawCalls++;
+      first = last;
+    }
+    multiDrawIndirect.end(shader);
+    return nDrawCalls;
+  }
+
+  // find layers of the first diffuse and specular textures of given mesh
+  static void setTextureLayers(Mesh& mesh, const ModelData& data) {
+    for (const unsigned int index : mesh.indicesOfTextures) {
+      const TextureLayer& layer = data.textureLayers[index];
+      switch (data.textures[index].textureType) {
+        case TextureType::DIFFUSE:
+          if (!mesh.diffuseTexture) mesh.diffuseTexture = layer;
+          break;
+        case TextureType::SPECULAR:
+          if (!mesh.specularTexture) mesh.specularTexture = layer;
+          break;
+      }
+    }
+  }
+
+  // assign every decoded texture a layer in a texture array of its size,
+  // after resizing textures according to the resize policy.
+  // this does not touch GL, so it may run on any thread.
+  static void buildTextureArrays(ModelData& data) {
+    const auto buildStart = std::chrono::steady_clock::now();
+    using Size = std::pair<int, int>;
+
+    // most common size is the target of resizing
+    std::map<Size, std::size_t> counts;
+    for (const auto& texture : data.textures) {
+      if (texture.image) {
+        counts[{texture.image.width, texture.image.height}]++;
+      }
+    }
+    Size target;
+    std::size_t targetCount = 0;
+    for (const auto& [size, count] : counts) {
+      if (count > targetCount) {
+        target = size;
+        targetCount = count;
+      }
+    }
+
+    const TextureResizePolicy policy = data.options.textureResize;
+    std::atomic<std::size_t> nResized{0};
+    if (policy != TextureResizePolicy::None) {
+      ThreadPool::shared().parallelFor(
+          data.textures.size(), [&](std::size_t i) {
+            Image& image = data.textures[i].image;
+            if (!image) return;
+            const Size size(image.width, image.height);
+            if (size == target) return;
+            if (policy == TextureResizePolicy::Outliers &&
+                counts.at(size) - 1 > MAX_OUTLIER_SHARES) {
+              return;
+            }
+            image = image.resized(target.first, target.second);
+            nResized++;
+          });
+    }
+
+    // fill arrays of each size up to their layer limit
+    std::map<Size, std::uint32_t> openArrays;
+    data.textureLayers.assign(data.textures.size(), TextureLayer());
+    for (std::size_t i = 0; i < data.textures.size(); ++i) {
+      const Image& image = data.textures[i].image;
+      if (!image) continue;
+
+      const Size size(image.width, image.height);
+      auto it = openArrays.find(size);
+      if (it == openArrays.end() ||
+          data.textureArrays[it->second].layers == TextureArray::MAX_LAYERS) {
+        TextureArrayLayout layout;
+        layout.width = image.width;
+        layout.height = image.height;
+        data.textureArrays.push_back(layout);
+        it = openArrays.insert_or_assign(size, data.textureArrays.size() - 1)
+                 .first;
+      }
+      data.textureLayers[i].array = it->second;
+      data.textureLayers[i].layer = data.textureArrays[it->second].layers++;
+    }
+
+    // duplicates share the layer of their original
+    for (std::size_t i = 0; i < data.textures.size(); ++i) {
+      const std::uint32_t original = data.textures[i].duplicateOf;
+      if (original != TextureData::UNIQUE) {
+        data.textureLayers[i] = data.textureLayers[original];
+      }
+    }
+    const auto buildEnd = std::chrono::steady_clock::now();
+
+    // show info
+    std::cout << "[Model] texture arrays: " << data.textureArrays.size()
+              << " arrays, " << nResized << " textures resized in "
+              << toMilliseconds(buildEnd - buildStart) << " ms" << std::endl;
+  }
+
+  // decode every texture concurrently on worker threads. GL upload is left
+  // to the context thread. with deduplicateTextures, files are read and
+  // hashed first, and files with identical content are decoded once.
+  static bool decodeTextures(ModelData& data, LoadProgress& status) {
+    const auto decodeStart = std::chrono::steady_clock::now();
+    std::vector<MappedFile> files(
+        data.options.deduplicateTextures ? data.textures.size() : 0);
+    if (!files.empty()) findDuplicateTextures(data, files);
+
+    std::atomic<std::size_t> nDecoded{0};
+    ThreadPool& pool = ThreadPool::shared();
+    pool.parallelFor(data.textures.size(), [&](std::size_t i) {
+      if (status.cancelled) return;
+      // duplicates share the image of their original
+      TextureData& texture = data.textures[i];
+      if (texture.duplicateOf == TextureData::UNIQUE) {
+        if (!files.empty() && files[i]) {
+          texture.image.loadFromMemory(files[i].data(), files[i].size(),
+                                       texture.filepath);
+        } else {
+          texture.image.load(texture.filepath);
+        }
+      }
+      status.value = 0.7f + 0.3f * (nDecoded.fetch_add(1) + 1) /
+                                data.textures.size();
+    });
+    const auto decodeEnd = std::chrono::steady_clock::now();
+
+    if (status.cancelled) {
+      return false;
+    }
+
+    if (data.options.deduplicateTextures) {
+      std::size_t nDuplicates = 0;
+      std::size_t bytesSaved = 0;
+      for (const auto& texture : data.textures) {
+        if (texture.duplicateOf == TextureData::UNIQUE) continue;
+        nDuplicates++;
+        bytesSaved += data.textures[texture.duplicateOf].image.getSize();
+      }
+      std::cout << "[Model] texture deduplication: " << nDuplicates
+                << " duplicates of " << data.textures.size()
+                << " textures, " << MemoryUsage::toMegabytes(bytesSaved)
+                << " MB of decoded images saved" << std::endl;
+    }
+
+    // show info
+    std::cout << "[Model] texture decoding: "
+              << toMilliseconds(decodeEnd - decodeStart) << " ms ("
+              << data.textures.size() << " textures, " << pool.getNumThreads()
+              << " threads)" << std::endl;
+
+    return true;
+  }
+
+  // map texture files and mark textures whose file content equals that of
+  // an earlier texture. files are hashed on worker threads, and equal
+  // hashes are confirmed by comparing the files.
+  static void findDuplicateTextures(ModelData& data,
+                                    std::vector<MappedFile>& files) {
+    std::vector<std::uint64_t> hashes(data.textures.size());
+    ThreadPool::shared().parallelFor(data.textures.size(), [&](std::size_t i) {
+      if (files[i].open(data.textures[i].filepath)) {
+        hashes[i] = ContentHash::hash(files[i].data(), files[i].size());
+      }
+    });
+
+    std::unordered_multimap<std::uint64_t, std::uint32_t> originals;
+    for (std::uint32_t i = 0; i < data.textures.size(); ++i) {
+      if (!files[i]) continue;
+      const auto [first, last] = originals.equal_range(hashes[i]);
+      const auto it = std::find_if(first, last, [&](const auto& entry) {
+        const MappedFile& original = files[entry.second];
+        return original.size() == files[i].size() &&
+               std::memcmp(original.data(), files[i].data(),
+                           files[i].size()) == 0;
+      });
+      if (it != last) {
+        data.textures[i].duplicateOf = it->second;
+      } else {
+        originals.emplace(hashes[i], i);
+      }
+    }
+  }
+
+  template <typename Duration>
+  static double toMilliseconds(const Duration& duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+  }
+
+  // add node and its descendants to the scene graph in depth-first order.
+  // meshes are listed in order of their first reference, along with the
+  // nodes referencing them.
+  static void processNode(const aiNode* node, std::int32_t parent,
+                          SceneGraph& sceneGraph,
+                          std::vector<unsigned int>& meshIndices,
+                          std::vector<std::vector<std::uint32_t>>& meshNodes) {
+    // aiMatrix4x4 is row major, like AffineTransform
+    const aiMatrix4x4& m = node->mTransformation;
+    AffineTransform local;
+    local.rows[0] = glm::vec4(m.a1, m.a2, m.a3, m.a4);
+    local.rows[1] = glm::vec4(m.b1, m.b2, m.b3, m.b4);
+    local.rows[2] = glm::vec4(m.c1, m.c2, m.c3, m.c4);
+    const std::uint32_t index = sceneGraph.addNode(parent, local);
 
-  void processNode(const aiNode* node, const aiScene* scene,
-                   const std::string& parentPath) {
     // process all the node's meshes
     for (std::size_t i = 0; i < node->mNumMeshes; ++i) {
-      const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-      meshes.push_back(processMesh(mesh, scene, parentPath));
+      const unsigned int mesh = node->mMeshes[i];
+      if (meshNodes[mesh].empty()) meshIndices.push_back(mesh);
+      meshNodes[mesh].push_back(index);
     }
 
     for (std::size_t i = 0; i < node->mNumChildren; i++) {
-      processNode(node->mChildren[i], scene, parentPath);
+      processNode(node->mChildren[i], index, sceneGraph, meshIndices,
+                  meshNodes);
     }
   }
 
-  Mesh processMesh(const aiMesh* mesh, const aiScene* scene,
-                   const std::string& parentPath) {
-    std::vector<Vertex> vertices;
-    std::vector<unsigned int> indices;
-    Material material;
-    std::vector<unsigned int> indicesOfTextures;
+  // convert assimp mesh to MeshData. this runs on worker threads, so it must
+  // not touch GL or shared state. referenced textures are returned in
+  // textureReferences.
+  static MeshData processMesh(
+      const aiMesh* mesh, const aiScene* scene, const std::string& parentPath,
+      std::vector<TextureReference>& textureReferences) {
+    MeshData data;
+    std::vector<Vertex>& vertices = data.vertices;
+    std::vector<unsigned int>& indices = data.indices;
+    Material& material = data.material;
 
     // vertices
+    vertices.reserve(mesh->mNumVertices);
     for (std::size_t i = 0; i < mesh->mNumVertices; ++i) {
       Vertex vertex;
       vertex.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y,
@@ -125,7 +1432,10 @@ class Model {
       vertices.push_back(vertex);
     }
 
+    data.bounds = Bounds::compute(vertices.data(), vertices.size());
+
     // indices
+    indices.reserve(3 * mesh->mNumFaces);
     for (std::size_t i = 0; i < mesh->mNumFaces; ++i) {
       const aiFace& face = mesh->mFaces[i];
       for (std::size_t j = 0; j < face.mNumIndices; ++j) {
@@ -160,19 +1470,9 @@ class Model {
         aiString str;
         mat->GetTexture(aiTextureType_DIFFUSE, i, &str);
         const std::filesystem::path ps(str.C_Str());
-        const std::string texturePath = (psParent / ps).native();
-
-        const auto index = hasTexture(texturePath);
-        if (index) {
-          // add texture index
-          indicesOfTextures.push_back(index.value());
-        } else {
-          // add texture index
-          indicesOfTextures.push_back(textures.size());
-
-          // load texture
-          textures.emplace_back(texturePath, TextureType::DIFFUSE);
-        }
+        const std::string texturePath =
+            (psParent / ps).lexically_normal().string();
+        textureReferences.emplace_back(texturePath, TextureType::DIFFUSE);
       }
 
       // specular textures
@@ -181,34 +1481,14 @@ class Model {
         aiString str;
         mat->GetTexture(aiTextureType_SPECULAR, i, &str);
         const std::filesystem::path ps(str.C_Str());
-        const std::string texturePath = (psParent / ps).native();
-
-        const auto index = hasTexture(texturePath);
-        if (index) {
-          // add texture index
-          indicesOfTextures.push_back(index.value());
-        } else {
-          // add texture index
-          indicesOfTextures.push_back(textures.size());
-
-          // load texture
-          textures.emplace_back(texturePath, TextureType::SPECULAR);
-        }
+        const std::string texturePath =
+            (psParent / ps).lexically_normal().string();
+        textureReferences.emplace_back(texturePath, TextureType::SPECULAR);
       }
     }
 
-    return Mesh(vertices, indices, material, indicesOfTextures);
-  }
-
-  std::optional<std::size_t> hasTexture(const std::string& filepath) const {
-    for (std::size_t i = 0; i < textures.size(); ++i) {
-      const Texture& texture = textures[i];
-      if (texture.filepath == filepath) {
-        return i;
-      }
-    }
-    return std::nullopt;
+    return data;
   }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,99 @@
+#ifndef _MODEL_LOADER_H
+#define _MODEL_LOADER_H
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "model.h"
+
+// loads models on a background thread so that the render loop keeps running
+class ModelLoader {
+ public:
+  ModelLoader() {}
+  ModelLoader(const ModelLoader&) = delete;
+  ModelLoader& operator=(const ModelLoader&) = delete;
+
+  ~ModelLoader() { destroy(); }
+
+  // start loading given model. a load already in flight is cancelled.
+  void load(const std::string& filepath,
+            const LoadOptions& options = LoadOptions()) {
+    cancel();
+
+    current = std::make_shared<Job>();
+    workers.push_back({std::thread([job = current, filepath, options] {
+                         job->result = Model::importModel(filepath, options,
+                                                          &job->progress);
+                         job->finished = true;
+                       }),
+                       current});
+  }
+
+  // cancel the load in flight
+  void cancel() {
+    if (current) {
+      current->progress.cancelled = true;
+      current.reset();
+    }
+  }
+
+  bool isLoading() const { return current != nullptr; }
+
+  float getProgress() const {
+    return current ? current->progress.value.load() : 0.0f;
+  }
+
+  // return the loaded model once the current load has finished.
+  // call this every frame from the render loop.
+  std::optional<ModelData> poll() {
+    std::optional<ModelData> result;
+
+    // join finished loads
+    for (auto it = workers.begin(); it != workers.end();) {
+      if (!it->job->finished) {
+        ++it;
+        continue;
+      }
+
+      it->thread.join();
+      if (it->job == current) {
+        result = std::move(current->result);
+        current.reset();
+      }
+      it = workers.erase(it);
+    }
+
+    return result;
+  }
+
+  // cancel all loads and wait for the loading threads
+  void destroy() {
+    cancel();
+    for (auto& worker : workers) {
+      worker.job->progress.cancelled = true;
+      worker.thread.join();
+    }
+    workers.clear();
+  }
+
+ private:
+  struct Job {
+    LoadProgress progress;
+    std::atomic<bool> finished{false};
+    std::optional<ModelData> result;
+  };
+
+  struct Worker {
+    std::thread thread;
+    std::shared_ptr<Job> job;
+  };
+
+  std::shared_ptr<Job> current;  // load whose result will be used
+  std::vector<Worker> workers;   // loading threads not joined yet
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef _MULTI_DRAW_INDIRECT_H
+#define _MULTI_DRAW_INDIRECT_H
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "shader.h"
+#include "vertex_format.h"
+
+// layout of GL_DRAW_INDIRECT_BUFFER entries for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+  GLuint count;
+  GLuint instanceCount;
+  GLuint firstIndex;
+  GLint baseVertex;
+  GLuint baseInstance;
+};
+
+// submits many draws with a single glMultiDrawElementsIndirect.
+//
+// shaders have no gl_DrawID before GL 4.6, so each command passes its draw
+// index as baseInstance, and an instanced vertex attribute reading 0, 1, 2,
+// ... turns it into vDrawID. shaders fetch per-draw data from a buffer
+// texture at that index.
+class MultiDrawIndirect {
+ public:
+  // texture unit of the per-draw data buffer texture
+  static constexpr GLint DRAW_DATA_UNIT = 15;
+  // vec4s of per-draw data per draw
+  static constexpr std::size_t DRAW_DATA_STRIDE = 3;
+  // divisor of the draw ID attribute, larger than any instance count
+  static constexpr GLuint INSTANCE_DIVISOR = 1u << 30;
+
+  static bool isSupported() {
+    return GLAD_GL_ARB_draw_indirect && GLAD_GL_ARB_multi_draw_indirect &&
+           GLAD_GL_ARB_base_instance;
+  }
+
+  // point the drawData sampler of given shader to DRAW_DATA_UNIT. samplers
+  // of different types must not share a unit, even when unused.
+  static void setupShader(const Shader& shader) {
+    shader.setUniform("drawData", DRAW_DATA_UNIT);
+    shader.setUniform("useDrawData", false);
+  }
+
+  // set per-draw data, DRAW_DATA_STRIDE vec4s per draw
+  void setDrawData(const std::vector<glm::vec4>& drawData) {
+    if (!dataBuffer) {
+      glGenBuffers(1, &dataBuffer);
+      glGenTextures(1, &dataTexture);
+      glGenBuffers(1, &drawIDBuffer);
+      glGenBuffers(1, &commandBuffer);
+    }
+
+    glBindBuffer(GL_TEXTURE_BUFFER, dataBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, drawData.size() * sizeof(glm::vec4),
+                 drawData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, dataBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+    // draw IDs read by the instanced attribute
+    std::vector<GLuint> drawIDs(drawData.size() / DRAW_DATA_STRIDE);
+    std::iota(drawIDs.begin(), drawIDs.end(), 0);
+    glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawIDs.size() * sizeof(GLuint),
+                 drawIDs.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+
+  // upload commands of this frame
+  void setCommands(const std::vector<DrawElementsIndirectCommand>& commands) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                 commands.size() * sizeof(DrawElementsIndirectCommand),
+                 commands.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  // prepare bound VAO and given shader for draw()
+  void begin(const Shader& shader) const {
+    glBindBuffer(GL_ARRAY_BUFFER, drawIDBuffer);
+    glEnableVertexAttribArray(DRAW_ID_LOCATION);
+    glVertexAttribIPointer(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0,
+                           reinterpret_cast<void*>(0));
+    // draw ID stays constant over the instances of a command
+    glVertexAttribDivisor(DRAW_ID_LOCATION, INSTANCE_DIVISOR);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, dataTexture);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    shader.setUniform("useDrawData", true);
+  }
+
+  // submit commands [first, first + count) sharing given index type
+  void draw(const Shader& shader, GLenum indexType, std::size_t first,
+            std::size_t count) const {
+    shader.activate();
+    glMultiDrawElementsIndirect(
+        GL_TRIANGLES, indexType,
+        reinterpret_cast<void*>(first * sizeof(DrawElementsIndirectCommand)),
+        count, 0);
+  }
+
+  void end(const Shader& shader) const {
+    shader.setUniform("useDrawData", false);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0 + DRAW_DATA_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glDisableVertexAttribArray(DRAW_ID_LOCATION);
+  }
+
+  void destroy() {
+    if (dataBuffer) {
+      glDeleteBuffers(1, &dataBuffer);
+      glDeleteTextures(1, &dataTexture);
+      glDeleteBuffers(1, &drawIDBuffer);
+      glDeleteBuffers(1, &commandBuffer);
+    }
+    dataBuffer = 0;
+    dataTexture = 0;
+    drawIDBuffer = 0;
+    commandBuffer = 0;
+  }
+
+ private:
+  GLuint dataBuffer = 0;
+  GLuint dataTexture = 0;
+  GLuint drawIDBuffer = 0;
+  GLuint commandBuffer = 0;
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef _NATIVE_LOADER_H
+#define _NATIVE_LOADER_H
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string>
+
+// common ground of the loaders which read OBJ, PLY and STL files without
+// assimp. every loader has
+//   static std::optional<...> load(const std::string& filepath,
+//                                  std::atomic<float>& progress,
+//                                  const std::atomic<bool>& cancelled);
+// which does not touch GL and raises progress from 0 to 0.5, leaving the
+// rest to Model's mesh processing. it returns nullopt when the file cannot
+// be read, when loading was cancelled, or when the file uses features the
+// loader does not support, in which case Model loads it with assimp.
+class NativeLoader {
+ public:
+  // whether given file has given extension, such as ".ply", ignoring case
+  static bool hasExtension(const std::string& filepath,
+                           const std::string& extension) {
+    std::string fileExtension =
+        std::filesystem::path(filepath).extension().string();
+    std::transform(fileExtension.begin(), fileExtension.end(),
+                   fileExtension.begin(),
+                   [](unsigned char c) { return std::tolower(c); });
+    return fileExtension == extension;
+  }
+};
+
+#endif
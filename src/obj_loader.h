@@ -0,0 +1,591 @@
+#ifndef _OBJ_LOADER_H
+#define _OBJ_LOADER_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "texture.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
+
+// native loader of Wavefront OBJ files and their MTL materials. it gives
+// the meshes assimp gives with Model's import flags: polygons are
+// triangulated as fans, texture coordinates are flipped vertically and
+// faces without normals get face normals. every face corner becomes a
+// vertex, and faces are split into meshes by object or group and material.
+//
+// the file is memory-mapped and split into line-aligned chunks which are
+// parsed on worker threads. relative indices are resolved once the element
+// counts of the previous chunks are known, then meshes are assembled on
+// worker threads too. follows the contract in native_loader.h.
+class ObjLoader {
+ public:
+  using TextureReference = std::pair<std::string, TextureType>;
+
+  struct Result {
+    std::vector<MeshData> meshes;
+    // diffuse and specular textures referenced by each mesh
+    std::vector<std::vector<TextureReference>> textureReferences;
+    // paths of referenced material libraries, including missing ones
+    std::vector<std::string> materialLibraries;
+  };
+
+  // load given OBJ file. files using statements other than v, vt, vn, f, o,
+  // g, s, usemtl and mtllib are rejected.
+  static std::optional<Result> load(const std::string& filepath,
+                                    std::atomic<float>& progress,
+                                    const std::atomic<bool>& cancelled) {
+    MappedFile file;
+    if (!file.open(filepath)) return std::nullopt;
+
+    // parse chunks
+    const char* const text = reinterpret_cast<const char*>(file.data());
+    const std::size_t size = file.size();
+    ThreadPool& pool = ThreadPool::shared();
+    const std::size_t nChunks = std::clamp<std::size_t>(
+        size / MIN_CHUNK_SIZE, 1, 4 * pool.getNumThreads());
+    std::vector<std::size_t> starts(nChunks + 1, size);
+    starts[0] = 0;
+    for (std::size_t i = 1; i < nChunks; ++i) {
+      starts[i] = std::max(starts[i - 1],
+                           findNextLine(text, size, i * size / nChunks));
+    }
+
+    std::vector<Chunk> chunks(nChunks);
+    std::atomic<std::size_t> nParsed{0};
+    pool.parallelFor(nChunks, [&](std::size_t i) {
+      if (cancelled) return;
+      parseChunk(text + starts[i], text + starts[i + 1], chunks[i]);
+      progress = 0.4f * (nParsed.fetch_add(1) + 1) / nChunks;
+    });
+    if (cancelled) return std::nullopt;
+    for (const auto& chunk : chunks) {
+      if (!chunk.supported) return std::nullopt;
+    }
+
+    // gather elements of all chunks and make relative indices absolute
+    Elements elements;
+    std::vector<std::array<std::int32_t, 3>> offsets(nChunks);
+    std::size_t nPositions = 0, nTexcoords = 0, nNormals = 0;
+    for (std::size_t i = 0; i < nChunks; ++i) {
+      offsets[i] = {static_cast<std::int32_t>(nPositions),
+                    static_cast<std::int32_t>(nTexcoords),
+                    static_cast<std::int32_t>(nNormals)};
+      nPositions += chunks[i].positions.size();
+      nTexcoords += chunks[i].texcoords.size();
+      nNormals += chunks[i].normals.size();
+    }
+    if (std::max({nPositions, nTexcoords, nNormals}) > MAX_ELEMENTS) {
+      return std::nullopt;
+    }
+    elements.positions.resize(nPositions);
+    elements.texcoords.resize(nTexcoords);
+    elements.normals.resize(nNormals);
+    pool.parallelFor(nChunks, [&](std::size_t i) {
+      Chunk& chunk = chunks[i];
+      std::copy(chunk.positions.begin(), chunk.positions.end(),
+                elements.positions.begin() + offsets[i][0]);
+      std::copy(chunk.texcoords.begin(), chunk.texcoords.end(),
+                elements.texcoords.begin() + offsets[i][1]);
+      std::copy(chunk.normals.begin(), chunk.normals.end(),
+                elements.normals.begin() + offsets[i][2]);
+      chunk.positions = {};
+      chunk.texcoords = {};
+      chunk.normals = {};
+      for (const std::uint32_t slot : chunk.relativeSlots) {
+        chunk.corners[slot / 3][slot % 3] += offsets[i][slot % 3];
+      }
+    });
+
+    // split faces into meshes by object or group and material
+    std::vector<MeshFaces> meshFaces;
+    std::unordered_map<std::string, std::uint32_t> meshIndices;
+    std::vector<std::string> materialLibraries;
+    std::string group;
+    std::string material;
+    for (std::uint32_t i = 0; i < nChunks; ++i) {
+      const Chunk& chunk = chunks[i];
+      materialLibraries.insert(materialLibraries.end(),
+                               chunk.materialLibraries.begin(),
+                               chunk.materialLibraries.end());
+      std::uint32_t begin = 0;
+      for (std::size_t e = 0; e <= chunk.events.size(); ++e) {
+        const std::uint32_t end = e < chunk.events.size()
+                                      ? chunk.events[e].corner
+                                      : chunk.corners.size();
+        if (end > begin) {
+          const auto [it, inserted] = meshIndices.try_emplace(
+              group + '\n' + material, meshFaces.size());
+          if (inserted) meshFaces.push_back({material, {}});
+          meshFaces[it->second].runs.push_back({i, begin, end});
+        }
+        begin = end;
+        if (e < chunk.events.size()) {
+          const Event& event = chunk.events[e];
+          (event.isMaterial ? material : group) = event.name;
+        }
+      }
+    }
+
+    // materials
+    const std::filesystem::path parentPath =
+        std::filesystem::path(filepath).parent_path();
+    std::unordered_map<std::string, ObjMaterial> materials;
+    Result result;
+    for (const auto& library : materialLibraries) {
+      result.materialLibraries.push_back(
+          (parentPath / library).lexically_normal().string());
+      loadMaterials(result.materialLibraries.back(), materials);
+    }
+
+    // assemble meshes
+    result.meshes.resize(meshFaces.size());
+    result.textureReferences.resize(meshFaces.size());
+    std::atomic<bool> valid{true};
+    pool.parallelFor(meshFaces.size(), [&](std::size_t i) {
+      if (cancelled) return;
+      if (!buildMesh(meshFaces[i], chunks, elements, result.meshes[i])) {
+        valid = false;
+      }
+
+      const auto it = materials.find(meshFaces[i].material);
+      const ObjMaterial objMaterial =
+          it != materials.end() ? it->second : ObjMaterial();
+      result.meshes[i].material = objMaterial.material;
+      if (!objMaterial.diffuseTexture.empty()) {
+        result.textureReferences[i].emplace_back(
+            (parentPath / objMaterial.diffuseTexture).lexically_normal()
+                .string(),
+            TextureType::DIFFUSE);
+      }
+      if (!objMaterial.specularTexture.empty()) {
+        result.textureReferences[i].emplace_back(
+            (parentPath / objMaterial.specularTexture).lexically_normal()
+                .string(),
+            TextureType::SPECULAR);
+      }
+    });
+    if (cancelled || !valid) return std::nullopt;
+
+    progress = 0.5f;
+    return result;
+  }
+
+ private:
+  // chunks are at least this many bytes, so small files are not split
+  static constexpr std::size_t MIN_CHUNK_SIZE = 1 << 20;
+  // elements are addressed by 32-bit signed indices
+  static constexpr std::size_t MAX_ELEMENTS = 0x7fffffff;
+  static constexpr std::int32_t MISSING = -1;
+  // mantissas stop growing here, so that they never overflow
+  static constexpr std::uint64_t MAX_MANTISSA = 1000000000000000000ull;
+
+  // position, texture coordinate and normal indices of a face corner,
+  // 0-based or MISSING
+  using Corner = std::array<std::int32_t, 3>;
+
+  // change of object, group or material before a corner
+  struct Event {
+    std::uint32_t corner;
+    bool isMaterial;
+    std::string name;
+  };
+
+  // elements and triangulated faces of a range of lines. indices of
+  // relative corners are relative to the first element of the chunk until
+  // the offsets of the chunk are added.
+  struct Chunk {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+    std::vector<Corner> corners;               // three per triangle
+    std::vector<std::uint32_t> relativeSlots;  // corner * 3 + element
+    std::vector<Event> events;
+    std::vector<std::string> materialLibraries;
+    bool supported = true;
+  };
+
+  struct Elements {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> normals;
+  };
+
+  // corners [begin, end) of a chunk
+  struct Run {
+    std::uint32_t chunk;
+    std::uint32_t begin;
+    std::uint32_t end;
+  };
+
+  struct MeshFaces {
+    std::string material;
+    std::vector<Run> runs;
+  };
+
+  // defaults follow assimp's OBJ importer
+  struct ObjMaterial {
+    Material material{glm::vec3(0.6f), glm::vec3(0.0f), glm::vec3(0.0f),
+                      0.0f};
+    std::string diffuseTexture;
+    std::string specularTexture;
+  };
+
+  static std::size_t findNextLine(const char* text, std::size_t size,
+                                  std::size_t offset) {
+    const void* newline = std::memchr(text + offset, '\n', size - offset);
+    return newline ? static_cast<const char*>(newline) - text + 1 : size;
+  }
+
+  static void skipSpaces(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) ++p;
+  }
+
+  static bool isLineEnd(const char* p, const char* end) {
+    return p == end || *p == '\n' || *p == '\r' || *p == '#';
+  }
+
+  // parse a decimal number with optional fraction and exponent. digits
+  // beyond MAX_MANTISSA only scale the value. powers of ten up to 1e22 are
+  // exact in double, so common inputs are converted with a single rounding
+  // before the narrowing to float.
+  static bool parseFloat(const char*& p, const char* end, float& value) {
+    skipSpaces(p, end);
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    int nDigits = 0;
+    for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p, ++nDigits) {
+      if (mantissa < MAX_MANTISSA) {
+        mantissa = 10 * mantissa + (*p - '0');
+      } else {
+        exponent++;
+      }
+    }
+    if (p < end && *p == '.') {
+      for (++p; p < end && static_cast<unsigned>(*p - '0') < 10;
+           ++p, ++nDigits) {
+        if (mantissa < MAX_MANTISSA) {
+          mantissa = 10 * mantissa + (*p - '0');
+          exponent--;
+        }
+      }
+    }
+    if (nDigits == 0) return false;
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      ++p;
+      bool negativeExponent = false;
+      if (p < end && (*p == '-' || *p == '+')) negativeExponent = *p++ == '-';
+      if (p == end || static_cast<unsigned>(*p - '0') >= 10) return false;
+      int e = 0;
+      for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+        if (e < 10000) e = 10 * e + (*p - '0');
+      }
+      exponent += negativeExponent ? -e : e;
+    }
+
+    static constexpr double POWERS[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    double d = static_cast<double>(mantissa);
+    if (exponent >= 0 && exponent <= 22) {
+      d *= POWERS[exponent];
+    } else if (exponent < 0 && exponent >= -22) {
+      d /= POWERS[-exponent];
+    } else {
+      d *= std::pow(10.0, exponent);
+    }
+    value = static_cast<float>(negative ? -d : d);
+    return true;
+  }
+
+  static bool parseInt(const char*& p, const char* end, std::int64_t& value) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    if (p == end || static_cast<unsigned>(*p - '0') >= 10) return false;
+    std::int64_t v = 0;
+    for (; p < end && static_cast<unsigned>(*p - '0') < 10; ++p) {
+      if (v < (std::int64_t(1) << 40)) v = 10 * v + (*p - '0');
+    }
+    value = negative ? -v : v;
+    return true;
+  }
+
+  // rest of the line without surrounding spaces
+  static std::string_view parseRest(const char*& p, const char* end) {
+    skipSpaces(p, end);
+    const char* begin = p;
+    while (p < end && *p != '\n' && *p != '\r') ++p;
+    const char* last = p;
+    while (last > begin && (last[-1] == ' ' || last[-1] == '\t')) --last;
+    return std::string_view(begin, last - begin);
+  }
+
+  // whether line starts with given keyword followed by a space
+  static bool isKeyword(const char* p, const char* end,
+                        std::string_view word) {
+    return static_cast<std::size_t>(end - p) > word.size() &&
+           std::memcmp(p, word.data(), word.size()) == 0 &&
+           (p[word.size()] == ' ' || p[word.size()] == '\t');
+  }
+
+  static void parseChunk(const char* p, const char* end, Chunk& chunk) {
+    std::vector<Corner> polygon;
+    std::vector<unsigned char> relative;  // element mask per polygon corner
+    while (p < end && chunk.supported) {
+      skipSpaces(p, end);
+      bool valid = true;
+      if (isLineEnd(p, end)) {
+        // empty line or comment
+      } else if (isKeyword(p, end, "v")) {
+        p += 1;
+        glm::vec3 position;
+        valid = parseFloat(p, end, position.x) &&
+                parseFloat(p, end, position.y) &&
+                parseFloat(p, end, position.z);
+        chunk.positions.push_back(position);
+      } else if (isKeyword(p, end, "vt")) {
+        p += 2;
+        glm::vec2 texcoords(0.0f);
+        valid = parseFloat(p, end, texcoords.x);
+        skipSpaces(p, end);
+        if (!isLineEnd(p, end)) {
+          valid = valid && parseFloat(p, end, texcoords.y);
+        }
+        texcoords.y = 1.0f - texcoords.y;
+        chunk.texcoords.push_back(texcoords);
+      } else if (isKeyword(p, end, "vn")) {
+        p += 2;
+        glm::vec3 normal;
+        valid = parseFloat(p, end, normal.x) &&
+                parseFloat(p, end, normal.y) && parseFloat(p, end, normal.z);
+        chunk.normals.push_back(normal);
+      } else if (isKeyword(p, end, "f")) {
+        p += 1;
+        valid = parseFace(p, end, chunk, polygon, relative);
+      } else if (isKeyword(p, end, "o") || isKeyword(p, end, "g")) {
+        p += 1;
+        chunk.events.push_back({static_cast<std::uint32_t>(
+                                    chunk.corners.size()),
+                                false, std::string(parseRest(p, end))});
+      } else if (isKeyword(p, end, "usemtl")) {
+        p += 6;
+        chunk.events.push_back({static_cast<std::uint32_t>(
+                                    chunk.corners.size()),
+                                true, std::string(parseRest(p, end))});
+      } else if (isKeyword(p, end, "mtllib")) {
+        p += 6;
+        chunk.materialLibraries.emplace_back(parseRest(p, end));
+      } else if (isKeyword(p, end, "s")) {
+        // smoothing groups do not apply to given normals
+      } else {
+        valid = false;
+      }
+      chunk.supported = chunk.supported && valid;
+
+      // skip to next line. a trailing backslash would continue the line.
+      const char* lineEnd = static_cast<const char*>(
+          std::memchr(p, '\n', end - p));
+      if (!lineEnd) lineEnd = end;
+      const char* last = lineEnd;
+      while (last > p && (last[-1] == '\r' || last[-1] == ' ')) --last;
+      if (last > p && last[-1] == '\\') chunk.supported = false;
+      p = lineEnd < end ? lineEnd + 1 : end;
+    }
+  }
+
+  // parse corners of a face and add it as a fan of triangles
+  static bool parseFace(const char*& p, const char* end, Chunk& chunk,
+                        std::vector<Corner>& polygon,
+                        std::vector<unsigned char>& relative) {
+    polygon.clear();
+    relative.clear();
+    const std::size_t counts[3] = {chunk.positions.size(),
+                                   chunk.texcoords.size(),
+                                   chunk.normals.size()};
+    while (true) {
+      skipSpaces(p, end);
+      if (isLineEnd(p, end)) break;
+
+      Corner corner = {MISSING, MISSING, MISSING};
+      unsigned char mask = 0;
+      for (int element = 0; element < 3; ++element) {
+        if (element > 0) {
+          if (p == end || *p != '/') break;
+          ++p;
+          // empty texture coordinate index as in v//vn
+          if (p < end && *p == '/') continue;
+          if (element == 2 && (p == end || *p == ' ' || *p == '\t' ||
+                               *p == '\r' || *p == '\n')) {
+            break;
+          }
+        }
+        std::int64_t index;
+        if (!parseInt(p, end, index) || index == 0) return false;
+        if (index > 0) {
+          corner[element] = static_cast<std::int32_t>(
+              std::min<std::int64_t>(index - 1, MAX_ELEMENTS));
+        } else {
+          // relative to the elements parsed so far
+          const std::int64_t local = counts[element] + index;
+          if (local < -static_cast<std::int64_t>(MAX_ELEMENTS)) return false;
+          corner[element] = static_cast<std::int32_t>(local);
+          mask |= 1 << element;
+        }
+      }
+      polygon.push_back(corner);
+      relative.push_back(mask);
+    }
+    if (polygon.size() < 3) return false;
+
+    for (std::size_t i = 1; i + 1 < polygon.size(); ++i) {
+      for (const std::size_t k : {std::size_t(0), i, i + 1}) {
+        for (int element = 0; element < 3; ++element) {
+          if (relative[k] & (1 << element)) {
+            chunk.relativeSlots.push_back(3 * chunk.corners.size() + element);
+          }
+        }
+        chunk.corners.push_back(polygon[k]);
+      }
+    }
+    return true;
+  }
+
+  // one vertex per corner of given faces. returns false on indices out of
+  // range.
+  static bool buildMesh(const MeshFaces& faces,
+                        const std::vector<Chunk>& chunks,
+                        const Elements& elements, MeshData& mesh) {
+    std::size_t nCorners = 0;
+    for (const auto& run : faces.runs) nCorners += run.end - run.begin;
+    mesh.vertices.resize(nCorners);
+    mesh.indices.resize(nCorners);
+
+    const auto inRange = [](std::int32_t index, std::size_t size) {
+      return index >= 0 && static_cast<std::size_t>(index) < size;
+    };
+    std::size_t v = 0;
+    for (const auto& run : faces.runs) {
+      const std::vector<Corner>& corners = chunks[run.chunk].corners;
+      for (std::uint32_t c = run.begin; c < run.end; c += 3, v += 3) {
+        bool hasNormals = true;
+        for (int k = 0; k < 3; ++k) {
+          const Corner& corner = corners[c + k];
+          Vertex& vertex = mesh.vertices[v + k];
+          if (!inRange(corner[0], elements.positions.size())) return false;
+          vertex.position = elements.positions[corner[0]];
+
+          if (corner[1] == MISSING) {
+            vertex.texcoords = glm::vec2(0.0f);
+          } else if (inRange(corner[1], elements.texcoords.size())) {
+            vertex.texcoords = elements.texcoords[corner[1]];
+          } else {
+            return false;
+          }
+
+          if (corner[2] == MISSING) {
+            hasNormals = false;
+          } else if (inRange(corner[2], elements.normals.size())) {
+            vertex.normal = elements.normals[corner[2]];
+          } else {
+            return false;
+          }
+        }
+
+        // face normal for triangles without normals
+        if (!hasNormals) {
+          const glm::vec3 n = glm::cross(
+              mesh.vertices[v + 1].position - mesh.vertices[v].position,
+              mesh.vertices[v + 2].position - mesh.vertices[v].position);
+          const float length = glm::length(n);
+          const glm::vec3 normal = length > 0.0f ? n / length : n;
+          for (int k = 0; k < 3; ++k) mesh.vertices[v + k].normal = normal;
+        }
+      }
+    }
+    for (std::size_t i = 0; i < nCorners; ++i) {
+      mesh.indices[i] = static_cast<unsigned int>(i);
+    }
+    mesh.bounds = Bounds::compute(mesh.vertices.data(), mesh.vertices.size());
+    return true;
+  }
+
+  // add materials of given MTL file. missing files leave default materials,
+  // as with assimp.
+  static void loadMaterials(const std::string& filepath,
+                            std::unordered_map<std::string, ObjMaterial>&
+                                materials) {
+    MappedFile file;
+    if (!file.open(filepath)) return;
+
+    const char* const text = reinterpret_cast<const char*>(file.data());
+    const char* const end = text + file.size();
+    const char* p = text;
+    ObjMaterial* material = nullptr;
+    const auto parseColor = [&](glm::vec3& color) {
+      glm::vec3 c;
+      if (parseFloat(p, end, c.x) && parseFloat(p, end, c.y) &&
+          parseFloat(p, end, c.z)) {
+        color = c;
+      }
+    };
+    // texture file is the last argument, after any options
+    const auto parseTexture = [&](std::string& texture) {
+      const std::string_view rest = parseRest(p, end);
+      const std::size_t space = rest.find_last_of(" \t");
+      texture = std::string(
+          space == std::string_view::npos ? rest : rest.substr(space + 1));
+    };
+    while (p < end) {
+      skipSpaces(p, end);
+      if (isKeyword(p, end, "newmtl")) {
+        p += 6;
+        material = &materials[std::string(parseRest(p, end))];
+        *material = ObjMaterial();
+      } else if (material && isKeyword(p, end, "Kd")) {
+        p += 2;
+        parseColor(material->material.kd);
+      } else if (material && isKeyword(p, end, "Ks")) {
+        p += 2;
+        parseColor(material->material.ks);
+      } else if (material && isKeyword(p, end, "Ka")) {
+        p += 2;
+        parseColor(material->material.ka);
+      } else if (material && isKeyword(p, end, "Ns")) {
+        p += 2;
+        float shininess;
+        if (parseFloat(p, end, shininess)) {
+          material->material.shininess = shininess;
+        }
+      } else if (material && isKeyword(p, end, "map_Kd")) {
+        p += 6;
+        parseTexture(material->diffuseTexture);
+      } else if (material && isKeyword(p, end, "map_Ks")) {
+        p += 6;
+        parseTexture(material->specularTexture);
+      }
+      p = text + findNextLine(text, file.size(), p - text);
+    }
+  }
+
+};
+
+#endif
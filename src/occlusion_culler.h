@@ -0,0 +1,354 @@
+#ifndef _OCCLUSION_CULLER_H
+#define _OCCLUSION_CULLER_H
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_CULLER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+#include "mesh.h"
+#include "scene_graph.h"
+
+// triangles rasterized into the occlusion depth buffer
+struct Occluders {
+  std::vector<glm::vec3> vertices;  // in world space
+  std::vector<unsigned int> indices;
+  std::size_t nMeshes = 0;
+
+  // vertices in mesh space, and per occluder its scene graph node and first
+  // vertex, so that moved occluders can be transformed again
+  std::vector<glm::vec3> localVertices;
+  std::vector<std::uint32_t> nodes;
+  std::vector<std::uint32_t> firstVertices;  // plus the end of the last
+};
+
+// software occlusion culling on the CPU, so that results do not depend on
+// GPU queries or the GL implementation.
+//
+// each frame, occluder triangles are rasterized into a small depth buffer,
+// four pixels at a time with SSE. a hierarchical depth buffer holding the
+// farthest occluder depth of each texel is built from it, and a mesh is
+// occluded when the nearest point of its projected box lies behind every
+// texel the box covers.
+class OcclusionCuller {
+ public:
+  static constexpr int WIDTH = 256;  // height follows the aspect ratio
+
+  // occluders are the largest low-poly mesh instances, up to a triangle
+  // budget, with vertices in world space
+  static Occluders selectOccluders(const std::vector<MeshData>& meshes,
+                                   const std::vector<MeshInstance>& instances,
+                                   const SceneGraph& sceneGraph,
+                                   std::size_t maxMeshTriangles = 1024,
+                                   std::size_t maxTriangles = 1 << 15) {
+    std::vector<std::size_t> candidates;
+    std::vector<float> radii(instances.size(), 0.0f);
+    for (std::size_t i = 0; i < instances.size(); ++i) {
+      const MeshData& mesh = meshes[instances[i].mesh];
+      const std::size_t nTriangles = mesh.indexCount() / 3;
+      if (nTriangles > 0 && nTriangles <= maxMeshTriangles) {
+        candidates.push_back(i);
+        radii[i] = sceneGraph.getWorld(instances[i].node)
+                       .transformBounds(mesh.bounds)
+                       .radius;
+      }
+    }
+    std::stable_sort(
+        candidates.begin(), candidates.end(),
+        [&](std::size_t a, std::size_t b) { return radii[a] > radii[b]; });
+
+    Occluders occluders;
+    std::size_t nTriangles = 0;
+    for (const std::size_t i : candidates) {
+      const MeshData& mesh = meshes[instances[i].mesh];
+      if (nTriangles + mesh.indexCount() / 3 > maxTriangles) continue;
+      nTriangles += mesh.indexCount() / 3;
+
+      const AffineTransform& world = sceneGraph.getWorld(instances[i].node);
+      const unsigned int baseVertex = occluders.vertices.size();
+      const Vertex* vertices = mesh.vertexData();
+      for (std::size_t v = 0; v < mesh.vertexCount(); ++v) {
+        occluders.localVertices.push_back(vertices[v].position);
+        occluders.vertices.push_back(
+            world.transformPoint(vertices[v].position));
+      }
+      occluders.nodes.push_back(instances[i].node);
+      occluders.firstVertices.push_back(baseVertex);
+      const unsigned int* indices = mesh.indexData();
+      for (std::size_t j = 0; j < mesh.indexCount(); ++j) {
+        occluders.indices.push_back(baseVertex + indices[j]);
+      }
+      occluders.nMeshes++;
+    }
+    occluders.firstVertices.push_back(occluders.vertices.size());
+    return occluders;
+  }
+
+  void setOccluders(Occluders&& occluders) {
+    this->occluders = std::move(occluders);
+  }
+  const Occluders& getOccluders() const { return occluders; }
+
+  // transform occluders again whose nodes were moved by the last update()
+  // of given scene graph. occluders stay the ones selected at load time.
+  void updateTransforms(const SceneGraph& sceneGraph) {
+    for (std::size_t i = 0; i < occluders.nodes.size(); ++i) {
+      const std::uint32_t node = occluders.nodes[i];
+      if (!sceneGraph.wasUpdated(node)) continue;
+      const AffineTransform& world = sceneGraph.getWorld(node);
+      for (std::uint32_t v = occluders.firstVertices[i];
+           v < occluders.firstVertices[i + 1]; ++v) {
+        occluders.vertices[v] =
+            world.transformPoint(occluders.localVertices[v]);
+      }
+    }
+  }
+
+  // set depth buffer size from the aspect ratio of the viewport
+  void setAspectRatio(float aspect) {
+    const int height = std::clamp(
+        static_cast<int>(std::lround(WIDTH / std::max(aspect, 1e-3f))), 4,
+        WIDTH);
+    if (!levels.empty() && height == levels[0].height) return;
+
+    levels.clear();
+    int w = WIDTH;
+    int h = height;
+    while (true) {
+      Level level;
+      level.width = w;
+      level.height = h;
+      level.depth.resize(static_cast<std::size_t>(w) * h);
+      levels.push_back(std::move(level));
+      if (w == 1 && h == 1) break;
+      w = std::max(1, (w + 1) / 2);
+      h = std::max(1, (h + 1) / 2);
+    }
+  }
+
+  // rasterize occluders seen with given view projection
+  void render(const glm::mat4& viewProjection) {
+    if (levels.empty()) setAspectRatio(1.0f);
+    Level& base = levels[0];
+    std::fill(base.depth.begin(), base.depth.end(), 1.0f);
+
+    // to screen space, x and y in pixels and z in [-1, 1]
+    screen.resize(occluders.vertices.size());
+    for (std::size_t i = 0; i < occluders.vertices.size(); ++i) {
+      const glm::vec4 clip =
+          viewProjection * glm::vec4(occluders.vertices[i], 1.0f);
+      if (isNearClipped(clip)) {
+        // w < 0 marks vertex in front of the near plane
+        screen[i] = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+        continue;
+      }
+      const float invW = 1.0f / clip.w;
+      screen[i] = glm::vec4((0.5f * clip.x * invW + 0.5f) * base.width,
+                            (0.5f * clip.y * invW + 0.5f) * base.height,
+                            clip.z * invW, 1.0f);
+    }
+
+    for (std::size_t i = 0; i + 2 < occluders.indices.size(); i += 3) {
+      const glm::vec4& v0 = screen[occluders.indices[i + 0]];
+      const glm::vec4& v1 = screen[occluders.indices[i + 1]];
+      const glm::vec4& v2 = screen[occluders.indices[i + 2]];
+      // triangles crossing the near plane are skipped instead of clipped,
+      // which only makes culling less aggressive
+      if (v0.w < 0.0f || v1.w < 0.0f || v2.w < 0.0f) continue;
+      rasterizeTriangle(base, v0, v1, v2);
+    }
+
+    buildHierarchy();
+  }
+
+  // true when given bounds are hidden behind the occluders rendered last
+  bool isOccluded(const Bounds& bounds,
+                  const glm::mat4& viewProjection) const {
+    if (levels.empty() || bounds.isEmpty()) return false;
+    const Level& base = levels[0];
+
+    // screen rectangle and nearest depth of the box
+    float xMin = std::numeric_limits<float>::max();
+    float yMin = std::numeric_limits<float>::max();
+    float xMax = std::numeric_limits<float>::lowest();
+    float yMax = std::numeric_limits<float>::lowest();
+    float zMin = std::numeric_limits<float>::max();
+    for (int corner = 0; corner < 8; ++corner) {
+      const glm::vec3 p((corner & 1) ? bounds.max.x : bounds.min.x,
+                        (corner & 2) ? bounds.max.y : bounds.min.y,
+                        (corner & 4) ? bounds.max.z : bounds.min.z);
+      const glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+      // box reaches in front of the near plane
+      if (isNearClipped(clip)) return false;
+      const float invW = 1.0f / clip.w;
+      const float x = (0.5f * clip.x * invW + 0.5f) * base.width;
+      const float y = (0.5f * clip.y * invW + 0.5f) * base.height;
+      xMin = std::min(xMin, x);
+      xMax = std::max(xMax, x);
+      yMin = std::min(yMin, y);
+      yMax = std::max(yMax, y);
+      zMin = std::min(zMin, clip.z * invW);
+    }
+
+    int x0 = std::max(0, static_cast<int>(std::floor(xMin)));
+    int y0 = std::max(0, static_cast<int>(std::floor(yMin)));
+    int x1 = std::min(base.width - 1, static_cast<int>(std::floor(xMax)));
+    int y1 = std::min(base.height - 1, static_cast<int>(std::floor(yMax)));
+    // outside of the screen, left to frustum culling
+    if (x0 > x1 || y0 > y1) return false;
+
+    // coarsest level where the rectangle covers at most 4x4 texels
+    std::size_t l = 0;
+    while (l + 1 < levels.size() && (x1 - x0 >= 4 || y1 - y0 >= 4)) {
+      x0 >>= 1;
+      y0 >>= 1;
+      x1 >>= 1;
+      y1 >>= 1;
+      l++;
+    }
+
+    const Level& level = levels[l];
+    for (int y = y0; y <= y1; ++y) {
+      for (int x = x0; x <= x1; ++x) {
+        if (level.depth[y * level.width + x] >= zMin) return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  static bool isNearClipped(const glm::vec4& clip) {
+    return clip.w <= 1e-5f || clip.z < -clip.w;
+  }
+
+  // depth buffer level. level 0 holds the nearest occluder depth of each
+  // pixel, coarser levels the farthest depth of the 2x2 texels below.
+  struct Level {
+    int width;
+    int height;
+    std::vector<float> depth;
+  };
+
+  Occluders occluders;
+  std::vector<glm::vec4> screen;
+  std::vector<Level> levels;
+
+  // half-space rasterization, sampling at pixel centers
+  static void rasterizeTriangle(Level& level, glm::vec4 v0, glm::vec4 v1,
+                                glm::vec4 v2) {
+    float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area == 0.0f) return;
+    // occluders are solid from both sides
+    if (area < 0.0f) {
+      std::swap(v1, v2);
+      area = -area;
+    }
+
+    const int xMin = std::max(
+        0, static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))));
+    const int yMin = std::max(
+        0, static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))));
+    const int xMax = std::min(
+        level.width - 1,
+        static_cast<int>(std::floor(std::max({v0.x, v1.x, v2.x}))));
+    const int yMax = std::min(
+        level.height - 1,
+        static_cast<int>(std::floor(std::max({v0.y, v1.y, v2.y}))));
+    if (xMin > xMax || yMin > yMax) return;
+
+    // edge functions e = a * x + b * y + c, positive inside
+    const float a0 = v1.y - v2.y, b0 = v2.x - v1.x;
+    const float a1 = v2.y - v0.y, b1 = v0.x - v2.x;
+    const float a2 = v0.y - v1.y, b2 = v1.x - v0.x;
+    const float c0 = v1.x * v2.y - v2.x * v1.y;
+    const float c1 = v2.x * v0.y - v0.x * v2.y;
+    const float c2 = v0.x * v1.y - v1.x * v0.y;
+
+    // depth plane z = zA * x + zB * y + zC
+    const float invArea = 1.0f / area;
+    const float zA = (a0 * v0.z + a1 * v1.z + a2 * v2.z) * invArea;
+    const float zB = (b0 * v0.z + b1 * v1.z + b2 * v2.z) * invArea;
+    const float zC = (c0 * v0.z + c1 * v1.z + c2 * v2.z) * invArea;
+
+#ifdef OCCLUSION_CULLER_SSE2
+    const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 zero = _mm_setzero_ps();
+    for (int y = yMin; y <= yMax; ++y) {
+      const float py = y + 0.5f;
+      float* row = &level.depth[y * level.width];
+      for (int x = xMin; x <= xMax; x += 4) {
+        const __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)),
+                                     offsets);
+        const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), px),
+                                     _mm_set1_ps(b0 * py + c0));
+        const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), px),
+                                     _mm_set1_ps(b1 * py + c1));
+        const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), px),
+                                     _mm_set1_ps(b2 * py + c2));
+        const __m128 inside =
+            _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero),
+                                  _mm_cmpge_ps(e1, zero)),
+                       _mm_cmpge_ps(e2, zero));
+        int mask = _mm_movemask_ps(inside);
+        if (!mask) continue;
+
+        // keep lanes past the end of the row untouched
+        if (x + 4 > xMax + 1) mask &= (1 << (xMax + 1 - x)) - 1;
+        const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zA), px),
+                                    _mm_set1_ps(zB * py + zC));
+        alignas(16) float zs[4];
+        _mm_store_ps(zs, z);
+        for (int k = 0; k < 4; ++k) {
+          if (mask & (1 << k)) row[x + k] = std::min(row[x + k], zs[k]);
+        }
+      }
+    }
+#else
+    for (int y = yMin; y <= yMax; ++y) {
+      const float py = y + 0.5f;
+      float* row = &level.depth[y * level.width];
+      for (int x = xMin; x <= xMax; ++x) {
+        const float px = x + 0.5f;
+        if (a0 * px + b0 * py + c0 < 0.0f || a1 * px + b1 * py + c1 < 0.0f ||
+            a2 * px + b2 * py + c2 < 0.0f) {
+          continue;
+        }
+        row[x] = std::min(row[x], zA * px + zB * py + zC);
+      }
+    }
+#endif
+  }
+
+  // fill coarser levels with the farthest depth of the texels below
+  void buildHierarchy() {
+    for (std::size_t l = 1; l < levels.size(); ++l) {
+      const Level& fine = levels[l - 1];
+      Level& coarse = levels[l];
+      for (int y = 0; y < coarse.height; ++y) {
+        const int fy0 = std::min(2 * y, fine.height - 1);
+        const int fy1 = std::min(2 * y + 1, fine.height - 1);
+        for (int x = 0; x < coarse.width; ++x) {
+          const int fx0 = std::min(2 * x, fine.width - 1);
+          const int fx1 = std::min(2 * x + 1, fine.width - 1);
+          coarse.depth[y * coarse.width + x] =
+              std::max(std::max(fine.depth[fy0 * fine.width + fx0],
+                                fine.depth[fy0 * fine.width + fx1]),
+                       std::max(fine.depth[fy1 * fine.width + fx0],
+                                fine.depth[fy1 * fine.width + fx1]));
+        }
+      }
+    }
+  }
+};
+
+#endif
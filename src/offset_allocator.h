@@ -0,0 +1,273 @@
+#ifndef _OFFSET_ALLOCATOR_H
+#define _OFFSET_ALLOCATOR_H
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// sub-allocates ranges of an abstract offset space [0, size), such as the
+// elements of a GPU buffer. it stores no data itself.
+//
+// free ranges are kept in two-level segregated fit bins(Masmano et al.,
+// "TLSF: a New Dynamic Memory Allocator for Real-Time Systems", 2004): the
+// first level splits sizes by power of two and the second level splits each
+// power of two into 8 linear steps. bitmasks over the bins find a fitting
+// free range in constant time, and freed ranges are merged with free
+// neighbors immediately.
+class OffsetAllocator {
+ public:
+  static constexpr std::uint32_t NO_NODE = ~0u;
+
+  struct Allocation {
+    std::uint32_t offset = 0;
+    std::uint32_t node = NO_NODE;  // NO_NODE for empty allocations
+  };
+
+  explicit OffsetAllocator(std::uint32_t size = 0) { reset(size); }
+
+  // forget every allocation and manage [0, size)
+  void reset(std::uint32_t size) {
+    nodes.clear();
+    unusedNodes.clear();
+    binHeads.fill(NO_NODE);
+    binMasks.fill(0);
+    groupMask = 0;
+    lastNode = NO_NODE;
+    this->size = 0;
+    freeSize = 0;
+    grow(size);
+  }
+
+  // extend managed range to [0, newSize). allocations stay where they are.
+  void grow(std::uint32_t newSize) {
+    if (newSize <= size) return;
+    const std::uint32_t added = newSize - size;
+
+    if (lastNode != NO_NODE && !nodes[lastNode].used) {
+      removeFromBin(lastNode);
+      nodes[lastNode].size += added;
+      insertIntoBin(lastNode);
+    } else {
+      const std::uint32_t node = createNode(size, added, lastNode, NO_NODE);
+      if (lastNode != NO_NODE) nodes[lastNode].neighborNext = node;
+      lastNode = node;
+      insertIntoBin(node);
+    }
+
+    size = newSize;
+    freeSize += added;
+  }
+
+  // returns nullopt when there is no free range large enough
+  std::optional<Allocation> allocate(std::uint32_t allocationSize) {
+    if (allocationSize == 0) return Allocation();
+
+    std::uint32_t node = NO_NODE;
+    const std::uint32_t bin = findFreeBin(binIndex(allocationSize, true));
+    if (bin != NO_BIN) {
+      node = binHeads[bin];
+    } else {
+      // ranges in the bin of size itself may still fit
+      node = binHeads[binIndex(allocationSize, false)];
+      while (node != NO_NODE && nodes[node].size < allocationSize) {
+        node = nodes[node].binNext;
+      }
+      if (node == NO_NODE) return std::nullopt;
+    }
+    removeFromBin(node);
+    nodes[node].used = true;
+    freeSize -= nodes[node].size;
+
+    // return the rest of the range to the bins
+    if (nodes[node].size > allocationSize) {
+      const std::uint32_t rest = createNode(
+          nodes[node].offset + allocationSize,
+          nodes[node].size - allocationSize, node, nodes[node].neighborNext);
+      if (nodes[node].neighborNext != NO_NODE) {
+        nodes[nodes[node].neighborNext].neighborPrev = rest;
+      } else {
+        lastNode = rest;
+      }
+      nodes[node].neighborNext = rest;
+      nodes[node].size = allocationSize;
+      freeSize += nodes[rest].size;
+      insertIntoBin(rest);
+    }
+
+    Allocation allocation;
+    allocation.offset = nodes[node].offset;
+    allocation.node = node;
+    return allocation;
+  }
+
+  void free(const Allocation& allocation) {
+    std::uint32_t node = allocation.node;
+    if (node == NO_NODE) return;
+
+    nodes[node].used = false;
+    freeSize += nodes[node].size;
+
+    // merge with free neighbors
+    const std::uint32_t prev = nodes[node].neighborPrev;
+    if (prev != NO_NODE && !nodes[prev].used) {
+      removeFromBin(prev);
+      nodes[prev].size += nodes[node].size;
+      unlinkNeighbor(node);
+      node = prev;
+    }
+    const std::uint32_t next = nodes[node].neighborNext;
+    if (next != NO_NODE && !nodes[next].used) {
+      removeFromBin(next);
+      nodes[node].size += nodes[next].size;
+      unlinkNeighbor(next);
+    }
+
+    insertIntoBin(node);
+  }
+
+  std::uint32_t getSize() const { return size; }
+  std::uint32_t getFreeSize() const { return freeSize; }
+  std::uint32_t getUsedSize() const { return size - freeSize; }
+
+ private:
+  static constexpr std::uint32_t SECOND_LEVEL_BITS = 3;
+  static constexpr std::uint32_t SECOND_LEVEL_COUNT = 1 << SECOND_LEVEL_BITS;
+  static constexpr std::uint32_t N_GROUPS = 32;
+  static constexpr std::uint32_t N_BINS = N_GROUPS * SECOND_LEVEL_COUNT;
+  static constexpr std::uint32_t NO_BIN = ~0u;
+
+  struct Node {
+    std::uint32_t offset;
+    std::uint32_t size;
+    std::uint32_t binPrev;  // free list of the bin
+    std::uint32_t binNext;
+    std::uint32_t neighborPrev;  // adjacent ranges
+    std::uint32_t neighborNext;
+    bool used;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<std::uint32_t> unusedNodes;
+  std::array<std::uint32_t, N_BINS> binHeads;
+  std::array<std::uint8_t, N_GROUPS> binMasks;  // non-empty bins per group
+  std::uint32_t groupMask;                      // groups with non-empty bins
+  std::uint32_t lastNode;                       // node at the end of range
+  std::uint32_t size;
+  std::uint32_t freeSize;
+
+  static std::uint32_t lowestBit(std::uint32_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+  }
+
+  static std::uint32_t highestBit(std::uint32_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse(&index, x);
+    return index;
+#else
+    return 31 - __builtin_clz(x);
+#endif
+  }
+
+  // bin of given size. rounding up gives the first bin whose ranges all
+  // fit size, rounding down the bin a free range of size belongs to.
+  static std::uint32_t binIndex(std::uint32_t size, bool roundUp) {
+    if (size < SECOND_LEVEL_COUNT) return size;
+
+    const std::uint32_t firstLevel = highestBit(size);
+    const std::uint32_t shift = firstLevel - SECOND_LEVEL_BITS;
+    std::uint32_t bin = ((firstLevel - SECOND_LEVEL_BITS + 1)
+                         << SECOND_LEVEL_BITS) |
+                        ((size >> shift) & (SECOND_LEVEL_COUNT - 1));
+    if (roundUp && (size & ((1u << shift) - 1))) bin++;
+    return bin;
+  }
+
+  // first non-empty bin at or after given bin
+  std::uint32_t findFreeBin(std::uint32_t bin) const {
+    if (bin >= N_BINS) return NO_BIN;
+
+    const std::uint32_t group = bin / SECOND_LEVEL_COUNT;
+    const std::uint32_t mask =
+        binMasks[group] & (0xffu << (bin % SECOND_LEVEL_COUNT)) & 0xffu;
+    if (mask) return group * SECOND_LEVEL_COUNT + lowestBit(mask);
+
+    if (group + 1 >= N_GROUPS) return NO_BIN;
+    const std::uint32_t groups = groupMask & (~0u << (group + 1));
+    if (!groups) return NO_BIN;
+    const std::uint32_t nextGroup = lowestBit(groups);
+    return nextGroup * SECOND_LEVEL_COUNT + lowestBit(binMasks[nextGroup]);
+  }
+
+  std::uint32_t createNode(std::uint32_t offset, std::uint32_t size,
+                           std::uint32_t neighborPrev,
+                           std::uint32_t neighborNext) {
+    const Node node{offset,       size,         NO_NODE, NO_NODE,
+                    neighborPrev, neighborNext, false};
+    if (!unusedNodes.empty()) {
+      const std::uint32_t index = unusedNodes.back();
+      unusedNodes.pop_back();
+      nodes[index] = node;
+      return index;
+    }
+    nodes.push_back(node);
+    return nodes.size() - 1;
+  }
+
+  // remove node from the chain of adjacent ranges after its range was
+  // merged into its previous neighbor
+  void unlinkNeighbor(std::uint32_t node) {
+    const std::uint32_t prev = nodes[node].neighborPrev;
+    const std::uint32_t next = nodes[node].neighborNext;
+    nodes[prev].neighborNext = next;
+    if (next != NO_NODE) {
+      nodes[next].neighborPrev = prev;
+    } else {
+      lastNode = prev;
+    }
+    unusedNodes.push_back(node);
+  }
+
+  void insertIntoBin(std::uint32_t node) {
+    const std::uint32_t bin = binIndex(nodes[node].size, false);
+    const std::uint32_t head = binHeads[bin];
+    nodes[node].binPrev = NO_NODE;
+    nodes[node].binNext = head;
+    if (head != NO_NODE) nodes[head].binPrev = node;
+    binHeads[bin] = node;
+
+    const std::uint32_t group = bin / SECOND_LEVEL_COUNT;
+    binMasks[group] |= 1u << (bin % SECOND_LEVEL_COUNT);
+    groupMask |= 1u << group;
+  }
+
+  void removeFromBin(std::uint32_t node) {
+    const std::uint32_t bin = binIndex(nodes[node].size, false);
+    const std::uint32_t prev = nodes[node].binPrev;
+    const std::uint32_t next = nodes[node].binNext;
+    if (prev != NO_NODE) {
+      nodes[prev].binNext = next;
+    } else {
+      binHeads[bin] = next;
+    }
+    if (next != NO_NODE) nodes[next].binPrev = prev;
+
+    if (binHeads[bin] == NO_NODE) {
+      const std::uint32_t group = bin / SECOND_LEVEL_COUNT;
+      binMasks[group] &= ~(1u << (bin % SECOND_LEVEL_COUNT));
+      if (!binMasks[group]) groupMask &= ~(1u << group);
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef _PLY_LOADER_H
+#define _PLY_LOADER_H
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_normals.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
+
+// native loader of binary PLY files. the file is memory-mapped and vertices
+// and faces are converted in place on worker threads, into buffers of their
+// final size. vertices with exactly the layout of Vertex are copied as is.
+// polygons are triangulated as fans, and meshes without normals get smooth
+// normals. follows the contract in native_loader.h.
+class PlyLoader {
+ public:
+  // load given PLY file. ASCII files and files without faces are rejected.
+  static std::optional<MeshData> load(const std::string& filepath,
+                                      std::atomic<float>& progress,
+                                      const std::atomic<bool>& cancelled) {
+    MappedFile file;
+    if (!file.open(filepath)) return std::nullopt;
+    const unsigned char* const fileEnd = file.data() + file.size();
+    std::optional<Header> header = parseHeader(file.data(), file.size());
+    if (!header) return std::nullopt;
+
+    // find vertex and face data
+    const Element* vertexElement = nullptr;
+    const Element* faceElement = nullptr;
+    const unsigned char* vertexData = nullptr;
+    const unsigned char* faceData = nullptr;
+    const unsigned char* p = file.data() + header->dataOffset;
+    for (const auto& element : header->elements) {
+      if (element.name == "vertex") {
+        vertexElement = &element;
+        vertexData = p;
+      } else if (element.name == "face") {
+        faceElement = &element;
+        faceData = p;
+      }
+      if (vertexElement && faceElement) break;
+      p = skipElement(element, p, fileEnd, header->bigEndian);
+      if (!p) return std::nullopt;
+    }
+    if (!vertexElement || !faceElement || vertexElement->count == 0 ||
+        vertexElement->count > MAX_INDICES) {
+      return std::nullopt;
+    }
+
+    MeshData mesh;
+    bool hasNormals = false;
+    if (!readVertices(*vertexElement, vertexData, fileEnd, header->bigEndian,
+                      mesh.vertices, hasNormals)) {
+      return std::nullopt;
+    }
+    progress = 0.2f;
+    if (cancelled) return std::nullopt;
+
+    if (!readFaces(*faceElement, faceData, fileEnd, header->bigEndian,
+                   mesh.vertices.size(), mesh.indices) ||
+        mesh.indices.empty()) {
+      return std::nullopt;
+    }
+    progress = 0.4f;
+    if (cancelled) return std::nullopt;
+
+    if (!hasNormals) MeshNormals::computeSmooth(mesh.vertices, mesh.indices);
+    mesh.bounds = Bounds::compute(mesh.vertices.data(), mesh.vertices.size());
+    // defaults of assimp's PLY importer
+    mesh.material = Material{glm::vec3(0.6f), glm::vec3(0.6f),
+                             glm::vec3(0.05f), 0.0f};
+
+    progress = 0.5f;
+    return mesh;
+  }
+
+ private:
+  // vertices and corners are addressed by 32-bit indices
+  static constexpr std::size_t MAX_INDICES = 0xffffffffu;
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+
+  enum class Type { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float, Double };
+
+  struct Property {
+    std::string name;
+    Type type;  // type of list items for lists
+    bool isList = false;
+    Type countType = Type::UInt8;
+  };
+
+  struct Element {
+    std::string name;
+    std::size_t count;
+    std::vector<Property> properties;
+  };
+
+  struct Header {
+    std::vector<Element> elements;
+    bool bigEndian = false;
+    std::size_t dataOffset = 0;  // of the first element
+  };
+
+  // vertex property read into a float of Vertex
+  struct Attribute {
+    std::size_t offset;  // in the vertex row
+    Type type;
+  };
+
+  // start of a block of BLOCK_SIZE face rows and index of its first
+  // triangle
+  struct FaceBlock {
+    const unsigned char* data;
+    std::size_t triangle;
+  };
+
+  static std::optional<Header> parseHeader(const unsigned char* data,
+                                           std::size_t size) {
+    static constexpr char END[] = "end_header";
+    const char* const text = reinterpret_cast<const char*>(data);
+    const char* const end = std::search(text, text + size, END,
+                                        END + sizeof(END) - 1);
+    const char* const newline =
+        static_cast<const char*>(std::memchr(end, '\n', text + size - end));
+    if (size < 4 || std::memcmp(text, "ply", 3) != 0 || !newline) {
+      return std::nullopt;
+    }
+
+    Header header;
+    header.dataOffset = newline + 1 - text;
+    std::istringstream lines(std::string(text, end));
+    std::string line;
+    bool hasFormat = false;
+    std::getline(lines, line);
+    while (std::getline(lines, line)) {
+      std::istringstream words(line);
+      std::string keyword;
+      words >> keyword;
+      if (keyword == "format") {
+        std::string format;
+        words >> format;
+        if (format != "binary_little_endian" &&
+            format != "binary_big_endian") {
+          return std::nullopt;
+        }
+        header.bigEndian = format == "binary_big_endian";
+        hasFormat = true;
+      } else if (keyword == "element") {
+        Element element;
+        if (!(words >> element.name >> element.count)) return std::nullopt;
+        header.elements.push_back(std::move(element));
+      } else if (keyword == "property") {
+        Property property;
+        std::string type;
+        words >> type;
+        if (type == "list") {
+          std::string countType;
+          words >> countType >> type;
+          property.isList = true;
+          if (!parseType(countType, property.countType)) return std::nullopt;
+        }
+        if (!parseType(type, property.type) || !(words >> property.name) ||
+            header.elements.empty()) {
+          return std::nullopt;
+        }
+        header.elements.back().properties.push_back(std::move(property));
+      } else if (!keyword.empty() && keyword != "comment" &&
+                 keyword != "obj_info") {
+        return std::nullopt;
+      }
+    }
+    if (!hasFormat) return std::nullopt;
+    return header;
+  }
+
+  static bool parseType(const std::string& name, Type& type) {
+    static const std::pair<const char*, Type> TYPES[] = {
+        {"char", Type::Int8},     {"int8", Type::Int8},
+        {"uchar", Type::UInt8},   {"uint8", Type::UInt8},
+        {"short", Type::Int16},   {"int16", Type::Int16},
+        {"ushort", Type::UInt16}, {"uint16", Type::UInt16},
+        {"int", Type::Int32},     {"int32", Type::Int32},
+        {"uint", Type::UInt32},   {"uint32", Type::UInt32},
+        {"float", Type::Float},   {"float32", Type::Float},
+        {"double", Type::Double}, {"float64", Type::Double}};
+    for (const auto& [typeName, t] : TYPES) {
+      if (name == typeName) {
+        type = t;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static std::size_t sizeOf(Type type) {
+    switch (type) {
+      case Type::Int8:
+      case Type::UInt8:
+        return 1;
+      case Type::Int16:
+      case Type::UInt16:
+        return 2;
+      case Type::Int32:
+      case Type::UInt32:
+      case Type::Float:
+        return 4;
+      case Type::Double:
+        return 8;
+    }
+    return 0;
+  }
+
+  template <typename T>
+  static T load(const unsigned char* p, bool bigEndian) {
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, p, sizeof(T));
+    if (bigEndian) std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    std::memcpy(&value, bytes, sizeof(T));
+    return value;
+  }
+
+  static double read(const unsigned char* p, Type type, bool bigEndian) {
+    switch (type) {
+      case Type::Int8:
+        return load<std::int8_t>(p, bigEndian);
+      case Type::UInt8:
+        return load<std::uint8_t>(p, bigEndian);
+      case Type::Int16:
+        return load<std::int16_t>(p, bigEndian);
+      case Type::UInt16:
+        return load<std::uint16_t>(p, bigEndian);
+      case Type::Int32:
+        return load<std::int32_t>(p, bigEndian);
+      case Type::UInt32:
+        return load<std::uint32_t>(p, bigEndian);
+      case Type::Float:
+        return load<float>(p, bigEndian);
+      case Type::Double:
+        return load<double>(p, bigEndian);
+    }
+    return 0.0;
+  }
+
+  // bytes of each row, or 0 for elements with lists
+  static std::size_t getRowSize(const Element& element) {
+    std::size_t size = 0;
+    for (const auto& property : element.properties) {
+      if (property.isList) return 0;
+      size += sizeOf(property.type);
+    }
+    return size;
+  }
+
+  // end of given row, or nullptr if it exceeds the file. listCount is set
+  // to the item count of the list at index listIndex.
+  static const unsigned char* skipRow(const Element& element,
+                                      const unsigned char* p,
+                                      const unsigned char* end, bool bigEndian,
+                                      std::size_t listIndex = ~std::size_t(0),
+                                      std::size_t* listCount = nullptr) {
+    for (std::size_t i = 0; i < element.properties.size(); ++i) {
+      const Property& property = element.properties[i];
+      std::size_t size = sizeOf(property.type);
+      if (property.isList) {
+        const std::size_t countSize = sizeOf(property.countType);
+        if (static_cast<std::size_t>(end - p) < countSize) return nullptr;
+        const double count = read(p, property.countType, bigEndian);
+        if (count < 0.0) return nullptr;
+        if (i == listIndex) *listCount = static_cast<std::size_t>(count);
+        p += countSize;
+        size *= static_cast<std::size_t>(count);
+      }
+      if (static_cast<std::size_t>(end - p) < size) return nullptr;
+      p += size;
+    }
+    return p;
+  }
+
+  // end of given element, or nullptr if it exceeds the file
+  static const unsigned char* skipElement(const Element& element,
+                                          const unsigned char* p,
+                                          const unsigned char* end,
+                                          bool bigEndian) {
+    const std::size_t rowSize = getRowSize(element);
+    if (rowSize > 0) {
+      if (static_cast<std::size_t>(end - p) / rowSize < element.count) {
+        return nullptr;
+      }
+      return p + rowSize * element.count;
+    }
+    for (std::size_t i = 0; i < element.count && p; ++i) {
+      p = skipRow(element, p, end, bigEndian);
+    }
+    return p;
+  }
+
+  static bool readVertices(const Element& element, const unsigned char* data,
+                           const unsigned char* end, bool bigEndian,
+                           std::vector<Vertex>& vertices, bool& hasNormals) {
+    const std::size_t rowSize = getRowSize(element);
+    if (rowSize == 0 ||
+        static_cast<std::size_t>(end - data) / rowSize < element.count) {
+      return false;
+    }
+
+    // properties of the floats of Vertex, in order
+    static const char* const NAMES[][4] = {
+        {"x"}, {"y"}, {"z"}, {"nx"}, {"ny"}, {"nz"},
+        {"u", "s", "texture_u", "texture_s"},
+        {"v", "t", "texture_v", "texture_t"}};
+    static constexpr std::size_t N_FLOATS = sizeof(Vertex) / sizeof(float);
+    static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == N_FLOATS);
+    std::array<std::optional<Attribute>, N_FLOATS> attributes;
+    std::size_t offset = 0;
+    for (const auto& property : element.properties) {
+      for (std::size_t i = 0; i < N_FLOATS; ++i) {
+        for (const char* name : NAMES[i]) {
+          if (name && property.name == name && !attributes[i]) {
+            attributes[i] = Attribute{offset, property.type};
+          }
+        }
+      }
+      offset += sizeOf(property.type);
+    }
+    if (!attributes[0] || !attributes[1] || !attributes[2]) return false;
+    hasNormals = attributes[3] && attributes[4] && attributes[5];
+
+    // rows laid out like Vertex are copied, then their texture coordinates
+    // are flipped vertically like assimp's aiProcess_FlipUVs does
+    const bool hasV = attributes[7].has_value();
+    bool isVertex = !bigEndian && rowSize == sizeof(Vertex) &&
+                    hasNormals && attributes[6] && attributes[7];
+    for (std::size_t i = 0; i < N_FLOATS && isVertex; ++i) {
+      isVertex = attributes[i]->type == Type::Float &&
+                 attributes[i]->offset == i * sizeof(float);
+    }
+
+    const std::size_t nVertices = element.count;
+    vertices.resize(nVertices);
+    ThreadPool::shared().parallelFor(
+        (nVertices + BLOCK_SIZE - 1) / BLOCK_SIZE, [&](std::size_t b) {
+          const std::size_t first = b * BLOCK_SIZE;
+          const std::size_t last = std::min(nVertices, first + BLOCK_SIZE);
+          if (isVertex) {
+            std::memcpy(&vertices[first], data + first * rowSize,
+                        (last - first) * sizeof(Vertex));
+            for (std::size_t v = first; v < last; ++v) {
+              vertices[v].texcoords.y = 1.0f - vertices[v].texcoords.y;
+            }
+            return;
+          }
+          for (std::size_t v = first; v < last; ++v) {
+            const unsigned char* row = data + v * rowSize;
+            float floats[N_FLOATS];
+            for (std::size_t i = 0; i < N_FLOATS; ++i) {
+              floats[i] = attributes[i] ? static_cast<float>(read(
+                                              row + attributes[i]->offset,
+                                              attributes[i]->type, bigEndian))
+                                        : 0.0f;
+            }
+            if (hasV) floats[7] = 1.0f - floats[7];
+            std::memcpy(&vertices[v], floats, sizeof(Vertex));
+          }
+        });
+    return true;
+  }
+
+  // triangulate faces into indices. when the data has the size of
+  // triangles only, faces are assumed to be triangles, otherwise rows are
+  // scanned once to find where blocks of faces start. blocks are then
+  // converted on worker threads.
+  static bool readFaces(const Element& element, const unsigned char* data,
+                        const unsigned char* end, bool bigEndian,
+                        std::size_t nVertices,
+                        std::vector<unsigned int>& indices) {
+    std::size_t listIndex = element.properties.size();
+    for (std::size_t i = 0; i < element.properties.size(); ++i) {
+      const Property& property = element.properties[i];
+      if (property.isList && property.type != Type::Float &&
+          property.type != Type::Double &&
+          (property.name == "vertex_indices" ||
+           property.name == "vertex_index")) {
+        listIndex = i;
+      }
+    }
+    if (listIndex == element.properties.size()) return false;
+    const Property& list = element.properties[listIndex];
+
+    const std::size_t nFaces = element.count;
+    const std::size_t nBlocks = (nFaces + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<FaceBlock> blocks(nBlocks);
+    const std::size_t triangleSize =
+        sizeOf(list.countType) + 3 * sizeOf(list.type);
+    if (element.properties.size() == 1 && 3 * nFaces <= MAX_INDICES &&
+        static_cast<std::size_t>(end - data) / triangleSize >= nFaces) {
+      for (std::size_t b = 0; b < nBlocks; ++b) {
+        blocks[b] = {data + b * BLOCK_SIZE * triangleSize, b * BLOCK_SIZE};
+      }
+      indices.resize(3 * nFaces);
+      if (convertFaces(element, listIndex, blocks, true, nVertices, bigEndian,
+                       indices)) {
+        return true;
+      }
+    }
+
+    std::size_t nTriangles = 0;
+    const unsigned char* p = data;
+    for (std::size_t f = 0; f < nFaces; ++f) {
+      if (f % BLOCK_SIZE == 0) blocks[f / BLOCK_SIZE] = {p, nTriangles};
+      std::size_t count = 0;
+      p = skipRow(element, p, end, bigEndian, listIndex, &count);
+      if (!p) return false;
+      if (count >= 3) nTriangles += count - 2;
+    }
+    if (3 * nTriangles > MAX_INDICES) return false;
+    indices.resize(3 * nTriangles);
+    return convertFaces(element, listIndex, blocks, false, nVertices,
+                        bigEndian, indices);
+  }
+
+  // fan triangulation of given blocks of face rows, which are known to lie
+  // within the file. returns false on indices out of range, or when a face
+  // is not a triangle although onlyTriangles is set.
+  static bool convertFaces(const Element& element, std::size_t listIndex,
+                           const std::vector<FaceBlock>& blocks,
+                           bool onlyTriangles, std::size_t nVertices,
+                           bool bigEndian,
+                           std::vector<unsigned int>& indices) {
+    const Property& list = element.properties[listIndex];
+    const std::size_t indexSize = sizeOf(list.type);
+    std::atomic<bool> valid{true};
+    ThreadPool::shared().parallelFor(blocks.size(), [&](std::size_t b) {
+      const std::size_t nBlockFaces =
+          std::min(element.count - b * BLOCK_SIZE, BLOCK_SIZE);
+      const unsigned char* p = blocks[b].data;
+      unsigned int* out = indices.data() + 3 * blocks[b].triangle;
+      for (std::size_t f = 0; f < nBlockFaces; ++f) {
+        for (std::size_t i = 0; i < element.properties.size(); ++i) {
+          const Property& property = element.properties[i];
+          // counts of rows scanned before are known to be valid
+          double count = 1.0;
+          if (property.isList) {
+            count = read(p, property.countType, bigEndian);
+            p += sizeOf(property.countType);
+          }
+          if (i != listIndex) {
+            p += static_cast<std::size_t>(count) * sizeOf(property.type);
+            continue;
+          }
+
+          if (onlyTriangles && count != 3.0) {
+            valid = false;
+            return;
+          }
+          std::uint32_t first = 0, previous = 0;
+          const std::size_t nCorners = static_cast<std::size_t>(count);
+          for (std::size_t k = 0; k < nCorners; ++k, p += indexSize) {
+            const double index = read(p, list.type, bigEndian);
+            if (index < 0.0 || index >= nVertices) {
+              valid = false;
+              return;
+            }
+            const std::uint32_t current = static_cast<std::uint32_t>(index);
+            if (k == 0) first = current;
+            if (k >= 2) {
+              *out++ = first;
+              *out++ = previous;
+              *out++ = current;
+            }
+            previous = current;
+          }
+        }
+      }
+    });
+    return valid;
+  }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef _RADIX_SORT_H
+#define _RADIX_SORT_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// least significant digit radix sort of 64-bit keys carrying 32-bit values,
+// 8 bits per pass. histograms of every digit are built in one pass over the
+// keys, and passes whose digit is equal for every key are skipped, so
+// sparse key layouts cost only the passes they use. the sort is stable.
+// scratch buffers are kept between calls to avoid per-frame allocation.
+class RadixSort {
+ public:
+  void sort(std::vector<std::uint64_t>& keys,
+            std::vector<std::uint32_t>& values) {
+    const std::size_t n = keys.size();
+    if (n < 2) return;
+
+    std::array<std::array<std::uint32_t, RADIX>, PASSES> histograms{};
+    for (const std::uint64_t key : keys) {
+      for (std::size_t pass = 0; pass < PASSES; ++pass) {
+        histograms[pass][(key >> (pass * BITS)) & MASK]++;
+      }
+    }
+
+    tempKeys.resize(n);
+    tempValues.resize(n);
+    for (std::size_t pass = 0; pass < PASSES; ++pass) {
+      auto& histogram = histograms[pass];
+      const std::size_t shift = pass * BITS;
+      if (histogram[(keys[0] >> shift) & MASK] == n) continue;
+
+      // exclusive prefix sum gives the first output slot of each digit
+      std::uint32_t sum = 0;
+      for (auto& count : histogram) {
+        const std::uint32_t c = count;
+        count = sum;
+        sum += c;
+      }
+
+      for (std::size_t i = 0; i < n; ++i) {
+        const std::uint32_t slot = histogram[(keys[i] >> shift) & MASK]++;
+        tempKeys[slot] = keys[i];
+        tempValues[slot] = values[i];
+      }
+      std::swap(keys, tempKeys);
+      std::swap(values, tempValues);
+    }
+  }
+
+ private:
+  static constexpr std::size_t BITS = 8;
+  static constexpr std::size_t RADIX = 1 << BITS;
+  static constexpr std::uint64_t MASK = RADIX - 1;
+  static constexpr std::size_t PASSES = 64 / BITS;
+
+  std::vector<std::uint64_t> tempKeys;
+  std::vector<std::uint32_t> tempValues;
+};
+
+#endif
@@ -1,16 +1,24 @@
 #ifndef _RENDERER_H
 #define _RENDERER_H
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <optional>
+
 #include "camera.h"
+#include "camera_buffer.h"
+#include "geometry_arena.h"
+#include "gpu_timer.h"
 #include "model.h"
+#include "model_loader.h"
 #include "shader.h"
 #include "texture.h"
+#include "texture_uploader.h"
 
 enum class RenderMode { Position, Normal, TexCoords, Diffuse, Specular };
 
-struct alignas(16) CameraBlock {
-  alignas(64) glm::mat4 view;
-  alignas(64) glm::mat4 projection;
-};
+// how meshes outside of the view frustum are culled
+enum class CullingMode { None, Flat, BVH };
 
 class Renderer {
  public:
@@ -24,61 +32,199 @@ class Renderer {
                         "src/shaders/texcoords.frag"},
         diffuseShader{"src/shaders/shader.vert", "src/shaders/diffuse.frag"},
         specularShader{"src/shaders/shader.vert", "src/shaders/specular.frag"} {
-    // set view and projection matrix
-    cameraBlock.view = camera.computeViewMatrix();
-    cameraBlock.projection = camera.computeProjectionMatrix(width, height);
-
-    // setup camera UBO
-    glGenBuffers(1, &cameraUBO);
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &cameraBlock,
-                 GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, cameraUBO);
-    positionShader.setUBO("CameraBlock", 0);
-    normalShader.setUBO("CameraBlock", 0);
-    texCoordsShader.setUBO("CameraBlock", 0);
-    diffuseShader.setUBO("CameraBlock", 0);
-    specularShader.setUBO("CameraBlock", 0);
+    // setup camera UBO. matrices are written by the first render().
+    cameraBuffer.create();
+
+    // bind uniform blocks and texture units of every render mode
+    for (const Shader* shader : getShaders()) {
+      shader->setUBO("CameraBlock", 0);
+      MaterialBuffer::setupShader(*shader);
+      MultiDrawIndirect::setupShader(*shader);
+      Mesh::setupShader(*shader);
+      TransformBuffer::setupShader(*shader);
+    }
   }
 
   void render() {
-    // render model
+    updateFrameTime();
+
+    // swap in the model once background loading has finished
+    std::optional<ModelData> loadedModel = modelLoader.poll();
+    if (loadedModel) {
+      if (model) {
+        model.destroy();
+      }
+      model.upload(std::move(loadedModel.value()), geometryArena,
+                   textureUploader);
+      onModelLoaded();
+    }
+
+    // write camera changes of this frame at once
+    if (cameraDirty) {
+      cameraBlock.view = camera.computeViewMatrix();
+      cameraBlock.projection = camera.computeProjectionMatrix(width, height);
+      cameraBuffer.update(cameraBlock);
+      cameraDirty = false;
+    }
+    cameraUpdateTime = 0.95f * cameraUpdateTime +
+                       0.05f * cameraBuffer.getUpdateTime();
+    cameraBuffer.resetStatistics();
+
+    // apply node transforms changed since the last frame
+    model.updateTransforms();
+
+    // cull meshes outside of the view frustum
+    if (cullingMode == CullingMode::None) {
+      model.clearCulling();
+      nVisibleMeshes = model.getNumMeshes();
+    } else {
+      nVisibleMeshes = model.cull(cameraBlock.projection * cameraBlock.view,
+                                  cullingMode == CullingMode::BVH);
+    }
+    nOccludedMeshes = 0;
+    if (occlusionCulling) {
+      nOccludedMeshes =
+          model.cullOccluded(cameraBlock.projection * cameraBlock.view,
+                             static_cast<float>(width) / height);
+      nVisibleMeshes -= nOccludedMeshes;
+    }
+    nCulledMeshes = model.getNumMeshes() - nVisibleMeshes;
+    nVisibleInstances = model.getNumVisibleInstances();
+
+    // order draws
+    const auto drawListStart = std::chrono::steady_clock::now();
+    model.buildDrawList(camera.camPos, camera.camForward, sortDraws);
+    const float dt = std::chrono::duration<float, std::milli>(
+                         std::chrono::steady_clock::now() - drawListStart)
+                         .count();
+    drawListTime = drawListTime > 0.0f ? 0.95f * drawListTime + 0.05f * dt : dt;
+
+    // render model. state cached by shaders may have been changed by texture
+    // uploads and the UI since the last frame.
+    Shader::invalidateState();
+    Shader::resetStatistics();
+    drawTimer.begin();
     switch (renderMode) {
       case RenderMode::Position:
-        model.draw(positionShader);
+        nDrawCalls = model.draw(positionShader, multiDrawIndirect);
         break;
       case RenderMode::Normal:
-        model.draw(normalShader);
+        nDrawCalls = model.draw(normalShader, multiDrawIndirect);
         break;
       case RenderMode::TexCoords:
-        model.draw(texCoordsShader);
+        nDrawCalls = model.draw(texCoordsShader, multiDrawIndirect);
         break;
       case RenderMode::Diffuse:
-        model.draw(diffuseShader);
+        nDrawCalls = model.draw(diffuseShader, multiDrawIndirect);
         break;
       case RenderMode::Specular:
-        model.draw(specularShader);
+        nDrawCalls = model.draw(specularShader, multiDrawIndirect);
         break;
     }
+    drawTimer.end();
+    cameraBuffer.endFrame();
+    shaderStatistics = Shader::getStatistics();
   }
 
-  void loadModel(const std::string& filepath) {
+  void loadModel(const std::string& filepath,
+                 const LoadOptions& options = LoadOptions()) {
+    // cancel background loading
+    modelLoader.cancel();
+
     // destroy previous model
     if (model) {
       model.destroy();
     }
 
-    model.loadModel(filepath);
+    model.loadModel(filepath, geometryArena, textureUploader, options);
+    onModelLoaded();
+  }
+
+  // load model on a background thread. the current model keeps being
+  // rendered until the new one is ready.
+  void loadModelAsync(const std::string& filepath,
+                      const LoadOptions& options = LoadOptions()) {
+    modelLoader.load(filepath, options);
+  }
+
+  // average frame time in milliseconds
+  float getFrameTime() const { return frameTime; }
+
+  CullingMode getCullingMode() const { return cullingMode; }
+  void setCullingMode(const CullingMode& cullingMode) {
+    this->cullingMode = cullingMode;
+  }
+
+  // closest mesh along the view direction
+  std::optional<RayHit> raycastFromCamera() const {
+    return model.raycast(camera.camPos, camera.camForward);
+  }
+
+  // scene graph nodes of the model. changed transforms are applied by the
+  // next render().
+  std::size_t getNumNodes() const {
+    return model.getSceneGraph().getNumNodes();
+  }
+  glm::mat4 getNodeTransform(std::uint32_t node) const {
+    return model.getNodeTransform(node);
+  }
+  void setNodeTransform(std::uint32_t node, const glm::mat4& local) {
+    model.setNodeTransform(node, local);
+  }
+
+  bool getOcclusionCulling() const { return occlusionCulling; }
+  void setOcclusionCulling(bool occlusionCulling) {
+    this->occlusionCulling = occlusionCulling;
+  }
+
+  bool getMultiDrawIndirect() const { return multiDrawIndirect; }
+  void setMultiDrawIndirect(bool multiDrawIndirect) {
+    this->multiDrawIndirect = multiDrawIndirect;
   }
 
+  bool getSortDraws() const { return sortDraws; }
+  void setSortDraws(bool sortDraws) { this->sortDraws = sortDraws; }
+
+  // average CPU time of building the draw list and GPU time of drawing the
+  // model, in milliseconds
+  float getDrawListTime() const { return drawListTime; }
+  float getDrawTime() const { return drawTimer.getTime(); }
+
+  // average CPU time of camera UBO updates per frame in milliseconds
+  float getCameraUpdateTime() const { return cameraUpdateTime; }
+  bool isCameraBufferPersistent() const {
+    return cameraBuffer.isPersistent();
+  }
+
+  bool getStateCaching() const { return Shader::getStateCaching(); }
+  void setStateCaching(bool stateCaching) {
+    Shader::setStateCaching(stateCaching);
+  }
+
+  // number of draw calls issued in the last frame
+  std::size_t getNumDrawCalls() const { return nDrawCalls; }
+  // GL state changes issued by shaders in the last frame
+  const ShaderStatistics& getShaderStatistics() const {
+    return shaderStatistics;
+  }
+
+  // number of meshes drawn and culled in the last frame. culled meshes
+  // include occluded ones.
+  std::size_t getNumVisibleMeshes() const { return nVisibleMeshes; }
+  std::size_t getNumCulledMeshes() const { return nCulledMeshes; }
+  std::size_t getNumOccludedMeshes() const { return nOccludedMeshes; }
+  // number of mesh instances drawn in the last frame, and of all instances
+  std::size_t getNumVisibleInstances() const { return nVisibleInstances; }
+  std::size_t getNumInstances() const { return model.getNumInstances(); }
+
+  bool isLoadingModel() const { return modelLoader.isLoading(); }
+  float getLoadingProgress() const { return modelLoader.getProgress(); }
+
   void setResolution(int width, int height) {
     this->width = width;
     this->height = height;
 
-    // update projection matrix
-    cameraBlock.projection = camera.computeProjectionMatrix(width, height);
-    updateCameraUBO();
+    cameraDirty = true;
   }
 
   RenderMode getRenderMode() const { return renderMode; }
@@ -90,9 +236,7 @@ class Renderer {
   void setCameraFOV(float fov) {
     camera.fov = fov;
 
-    // update projection matrix
-    cameraBlock.projection = camera.computeProjectionMatrix(width, height);
-    updateCameraUBO();
+    cameraDirty = true;
   }
 
   float getCameraMovementSpeed() const { return camera.movementSpeed; }
@@ -100,14 +244,15 @@ class Renderer {
     camera.movementSpeed = movementSpeed;
   }
 
-  void resetCamera() { camera.reset(); }
+  void resetCamera() {
+    camera.reset();
+    cameraDirty = true;
+  }
 
   void moveCamera(const CameraMovement& direction, float deltaTime) {
     camera.move(direction, deltaTime);
 
-    // update view matrix
-    cameraBlock.view = camera.computeViewMatrix();
-    updateCameraUBO();
+    cameraDirty = true;
   }
 
   float getCameraLookAroundSpeed() const { return camera.lookAroundSpeed; }
@@ -118,19 +263,19 @@ class Renderer {
   void lookAroundCamera(float dPhi, float dTheta) {
     camera.lookAround(dPhi, dTheta);
 
-    // update view matrix
-    cameraBlock.view = camera.computeViewMatrix();
-    updateCameraUBO();
+    cameraDirty = true;
   }
 
   void destroy() {
-    glDeleteBuffers(1, &cameraUBO);
+    modelLoader.destroy();
+    cameraBuffer.destroy();
     model.destroy();
-    positionShader.destroy();
-    normalShader.destroy();
-    texCoordsShader.destroy();
-    diffuseShader.destroy();
-    specularShader.destroy();
+    geometryArena.destroy();
+    textureUploader.destroy();
+    drawTimer.destroy();
+    for (const Shader* shader : getShaders()) {
+      shader->destroy();
+    }
   }
 
  private:
@@ -138,7 +283,10 @@ class Renderer {
   int height;
   RenderMode renderMode;
   Camera camera;
+  GeometryArena geometryArena;
+  TextureUploader textureUploader;  // keeps its ring across model loads
   Model model;
+  ModelLoader modelLoader;
 
   Shader positionShader;
   Shader normalShader;
@@ -146,14 +294,59 @@ class Renderer {
   Shader diffuseShader;
   Shader specularShader;
 
-  GLuint cameraUBO;
+  CameraBuffer cameraBuffer{0};
   CameraBlock cameraBlock;
+  bool cameraDirty = true;  // camera changed since the last frame
+  float cameraUpdateTime = 0.0f;
+
+  CullingMode cullingMode = CullingMode::BVH;
+  bool occlusionCulling = false;
+  bool multiDrawIndirect = false;
+  std::size_t nDrawCalls = 0;
+  bool sortDraws = true;
+  float drawListTime = 0.0f;
+  GpuTimer drawTimer;
+  ShaderStatistics shaderStatistics;
+  std::size_t nVisibleMeshes = 0;
+  std::size_t nCulledMeshes = 0;
+  std::size_t nOccludedMeshes = 0;
+  std::size_t nVisibleInstances = 0;
+
+  // frame time statistics
+  std::chrono::steady_clock::time_point lastFrame;
+  float frameTime = 0.0f;
+  float frameTimeBeforeLoad = 0.0f;
+  int framesSinceLoad = -1;
+
+  // frame time is averaged exponentially, so wait some frames after a model
+  // is loaded before reporting it
+  static constexpr int FRAME_TIME_REPORT_DELAY = 120;
+
+  std::array<const Shader*, 5> getShaders() const {
+    return {&positionShader, &normalShader, &texCoordsShader, &diffuseShader,
+            &specularShader};
+  }
+
+  void updateFrameTime() {
+    const auto now = std::chrono::steady_clock::now();
+    if (lastFrame.time_since_epoch().count() > 0) {
+      const float dt =
+          std::chrono::duration<float, std::milli>(now - lastFrame).count();
+      frameTime = frameTime > 0.0f ? 0.95f * frameTime + 0.05f * dt : dt;
+    }
+    lastFrame = now;
+
+    if (framesSinceLoad >= 0 &&
+        ++framesSinceLoad == FRAME_TIME_REPORT_DELAY) {
+      std::cout << "[Renderer] frame time: " << frameTimeBeforeLoad
+                << " ms -> " << frameTime << " ms" << std::endl;
+      framesSinceLoad = -1;
+    }
+  }
 
-  void updateCameraUBO() {
-    glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), &cameraBlock,
-                 GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  void onModelLoaded() {
+    frameTimeBeforeLoad = frameTime;
+    framesSinceLoad = 0;
   }
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+#ifndef _SCENE_GRAPH_H
+#define _SCENE_GRAPH_H
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SCENE_GRAPH_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+
+// affine transform stored as the first three rows of its matrix, which is
+// the layout of assimp's aiMatrix4x4 and of the transform buffer read by the
+// shaders. the last row is always (0, 0, 0, 1).
+struct AffineTransform {
+  glm::vec4 rows[3] = {glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
+                       glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                       glm::vec4(0.0f, 0.0f, 1.0f, 0.0f)};
+
+  static AffineTransform fromMatrix(const glm::mat4& m) {
+    AffineTransform transform;
+    for (int i = 0; i < 3; ++i) {
+      transform.rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    return transform;
+  }
+
+  glm::mat4 toMatrix() const {
+    glm::mat4 m(1.0f);
+    for (int i = 0; i < 3; ++i) {
+      for (int j = 0; j < 4; ++j) m[j][i] = rows[i][j];
+    }
+    return m;
+  }
+
+  glm::vec3 transformPoint(const glm::vec3& p) const {
+    const glm::vec4 v(p, 1.0f);
+    return glm::vec3(glm::dot(rows[0], v), glm::dot(rows[1], v),
+                     glm::dot(rows[2], v));
+  }
+
+  // box around given bounds after transformation
+  Bounds transformBounds(const Bounds& bounds) const {
+    if (bounds.isEmpty()) return Bounds();
+    const glm::vec3 center = transformPoint(0.5f * (bounds.min + bounds.max));
+    const glm::vec3 extent = bounds.getExtent();
+    const glm::vec3 transformedExtent(
+        glm::dot(glm::abs(glm::vec3(rows[0])), extent),
+        glm::dot(glm::abs(glm::vec3(rows[1])), extent),
+        glm::dot(glm::abs(glm::vec3(rows[2])), extent));
+    return Bounds::fromBox(center - transformedExtent,
+                           center + transformedExtent);
+  }
+
+  // product a * b, applying b first
+  static void multiply(const AffineTransform& a, const AffineTransform& b,
+                       AffineTransform& out) {
+#ifdef SCENE_GRAPH_SSE2
+    // row i of the product is a[i][0] * b[0] + a[i][1] * b[1] +
+    // a[i][2] * b[2] + (0, 0, 0, a[i][3]). rows of a are loaded whole, since
+    // a is usually the parent transform stored just before.
+    const __m128 b0 = _mm_loadu_ps(&b.rows[0].x);
+    const __m128 b1 = _mm_loadu_ps(&b.rows[1].x);
+    const __m128 b2 = _mm_loadu_ps(&b.rows[2].x);
+    const __m128 wMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+    for (int i = 0; i < 3; ++i) {
+      const __m128 row = _mm_loadu_ps(&a.rows[i].x);
+      __m128 r = _mm_mul_ps(_mm_shuffle_ps(row, row, 0x00), b0);
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, 0x55), b1));
+      r = _mm_add_ps(r, _mm_mul_ps(_mm_shuffle_ps(row, row, 0xaa), b2));
+      r = _mm_add_ps(r, _mm_and_ps(row, wMask));
+      _mm_storeu_ps(&out.rows[i].x, r);
+    }
+#else
+    for (int i = 0; i < 3; ++i) {
+      out.rows[i] = a.rows[i][0] * b.rows[0] + a.rows[i][1] * b.rows[1] +
+                    a.rows[i][2] * b.rows[2] +
+                    glm::vec4(0.0f, 0.0f, 0.0f, a.rows[i][3]);
+    }
+#endif
+  }
+};
+
+// a mesh drawn with the world transform of a scene graph node
+struct MeshInstance {
+  std::uint32_t mesh;
+  std::uint32_t node;
+};
+
+// node hierarchy of a scene, flattened into arrays of parent indices, local
+// and world transforms. nodes are stored in depth-first order, so a parent
+// precedes its children and every subtree is a contiguous range. world
+// transforms are then propagated by one linear pass, and a changed node
+// recomputes only its own range.
+class SceneGraph {
+ public:
+  static constexpr std::int32_t NO_PARENT = -1;
+
+  using NodeRange = std::pair<std::uint32_t, std::uint32_t>;
+
+  // append node below given parent. nodes must be added in depth-first
+  // order, i.e. parent is the last added node or one of its ancestors.
+  std::uint32_t addNode(std::int32_t parent, const AffineTransform& local) {
+    const std::uint32_t node = parents.size();
+    parents.push_back(parent);
+    locals.push_back(local);
+    worlds.emplace_back();
+    dirty.push_back(1);
+    nDirty++;
+    structureChanged = true;
+    return node;
+  }
+
+  void setLocal(std::uint32_t node, const AffineTransform& local) {
+    locals[node] = local;
+    if (!dirty[node]) nDirty++;
+    dirty[node] = 1;
+  }
+
+  // recompute world transforms of changed subtrees. returns whether any
+  // world transform changed.
+  bool update() {
+    updatedRanges.clear();
+    if (nDirty == 0) return false;
+    if (structureChanged) computeSubtreeEnds();
+
+    const std::uint32_t nNodes = parents.size();
+    std::uint32_t node = 0;
+    while (true) {
+      node = std::find(dirty.begin() + node, dirty.end(), 1) - dirty.begin();
+      if (node == nNodes) break;
+
+      // ancestors are up to date, since they precede the range
+      const std::uint32_t end = subtreeEnds[node];
+      for (std::uint32_t i = node; i < end; ++i) {
+        const std::int32_t parent = parents[i];
+        if (parent == NO_PARENT) {
+          worlds[i] = locals[i];
+        } else {
+          AffineTransform::multiply(worlds[parent], locals[i], worlds[i]);
+        }
+        dirty[i] = 0;
+      }
+      updatedRanges.emplace_back(node, end);
+      node = end;
+    }
+    nDirty = 0;
+    return true;
+  }
+
+  // recompute every world transform on the next update()
+  void invalidate() {
+    std::fill(dirty.begin(), dirty.end(), 1);
+    nDirty = dirty.size();
+  }
+
+  // node ranges [first, end) whose world transforms were recomputed by the
+  // last update(), in increasing order
+  const std::vector<NodeRange>& getUpdatedRanges() const {
+    return updatedRanges;
+  }
+
+  // whether the last update() recomputed the world transform of given node
+  bool wasUpdated(std::uint32_t node) const {
+    const auto it = std::upper_bound(
+        updatedRanges.begin(), updatedRanges.end(), node,
+        [](std::uint32_t n, const NodeRange& range) {
+          return n < range.first;
+        });
+    return it != updatedRanges.begin() && node < std::prev(it)->second;
+  }
+
+  std::size_t getNumNodes() const { return parents.size(); }
+  const std::vector<std::int32_t>& getParents() const { return parents; }
+  const std::vector<AffineTransform>& getLocals() const { return locals; }
+  // valid after update()
+  const AffineTransform& getWorld(std::uint32_t node) const {
+    return worlds[node];
+  }
+
+  void clear() {
+    parents.clear();
+    locals.clear();
+    worlds.clear();
+    dirty.clear();
+    subtreeEnds.clear();
+    updatedRanges.clear();
+    nDirty = 0;
+    structureChanged = false;
+  }
+
+ private:
+  std::vector<std::int32_t> parents;
+  std::vector<AffineTransform> locals;
+  std::vector<AffineTransform> worlds;
+  std::vector<unsigned char> dirty;        // local changed since update()
+  std::vector<std::uint32_t> subtreeEnds;  // one past the last descendant
+  std::vector<NodeRange> updatedRanges;  // by the last update()
+  std::size_t nDirty = 0;
+  bool structureChanged = false;  // subtreeEnds are out of date
+
+  // children follow their parent, so a reverse pass sees every descendant
+  // of a node before the node itself
+  void computeSubtreeEnds() {
+    const std::uint32_t nNodes = parents.size();
+    subtreeEnds.resize(nNodes);
+    for (std::uint32_t i = 0; i < nNodes; ++i) subtreeEnds[i] = i + 1;
+    for (std::uint32_t i = nNodes; i-- > 0;) {
+      if (parents[i] != NO_PARENT) {
+        subtreeEnds[parents[i]] =
+            std::max(subtreeEnds[parents[i]], subtreeEnds[i]);
+      }
+    }
+    structureChanged = false;
+  }
+};
+
+#endif
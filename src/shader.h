@@ -1,10 +1,14 @@
 #ifndef _SHADER_H
 #define _SHADER_H
 
+#include <algorithm>
+#include <cstddef>
 #include <fstream>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -12,7 +16,23 @@
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
 
+// GL calls issued by shaders since the last Shader::resetStatistics()
+struct ShaderStatistics {
+  std::size_t programBinds = 0;     // glUseProgram
+  std::size_t locationQueries = 0;  // glGetUniformLocation
+  std::size_t uniformUpdates = 0;   // glUniform*
+  std::size_t textureBinds = 0;     // glActiveTexture, glBindTexture
+
+  std::size_t getTotal() const {
+    return programBinds + locationQueries + uniformUpdates + textureBinds;
+  }
+};
+
 class Shader {
+ public:
+  using UniformValue = std::variant<bool, GLint, GLuint, GLfloat, glm::vec2,
+                                    glm::vec3, glm::mat4>;
+
  private:
   const std::string vertexShaderFilepath;
   std::string vertexShaderSource;
@@ -22,6 +42,19 @@ class Shader {
   GLuint fragmentShader;
   GLuint program;
 
+  // locations of active uniforms by name, one per element for arrays
+  std::unordered_map<std::string, std::vector<GLint>> uniformLocations;
+  // last value set per location
+  mutable std::vector<std::optional<UniformValue>> uniformValues;
+
+  // GL state shared by every shader of the context
+  static constexpr GLuint NO_PROGRAM = ~0u;
+  static constexpr GLuint NO_TEXTURE = ~0u;
+  inline static GLuint boundProgram = NO_PROGRAM;
+  inline static std::vector<GLuint> boundTextures;  // per texture unit
+  inline static bool stateCaching = true;
+  inline static ShaderStatistics statistics;
+
   static std::string fileToString(const std::string& filepath) {
     std::ifstream file(filepath);
     if (!file) {
@@ -113,6 +146,51 @@ class Shader {
     }
   }
 
+  // resolve locations of every active uniform once after linking
+  void cacheUniformLocations() {
+    GLint nUniforms = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &nUniforms);
+    GLint maxNameLength = 0;
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    GLint maxLocation = -1;
+    std::vector<GLchar> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i = 0; i < nUniforms; ++i) {
+      GLsizei length = 0;
+      GLint size = 0;
+      GLenum type = 0;
+      glGetActiveUniform(program, i, nameBuffer.size(), &length, &size, &type,
+                         nameBuffer.data());
+      std::string name(nameBuffer.data(), length);
+
+      // arrays are reported by their first element
+      const bool isArray = name.size() > 3 &&
+                           name.compare(name.size() - 3, 3, "[0]") == 0;
+      if (isArray) name.resize(name.size() - 3);
+
+      // uniforms in blocks have no location
+      std::vector<GLint> locations;
+      for (GLint j = 0; j < size; ++j) {
+        const std::string elementName =
+            isArray ? name + "[" + std::to_string(j) + "]" : name;
+        const GLint location =
+            glGetUniformLocation(program, elementName.c_str());
+        if (location < 0) break;
+        locations.push_back(location);
+        maxLocation = std::max(maxLocation, location);
+      }
+      if (!locations.empty()) uniformLocations[name] = std::move(locations);
+    }
+    uniformValues.assign(maxLocation + 1, std::nullopt);
+  }
+
+  static void useProgram(GLuint program) {
+    if (stateCaching && boundProgram == program) return;
+    boundProgram = program;
+    glUseProgram(program);
+    statistics.programBinds++;
+  }
+
  public:
   Shader() {}
 
@@ -123,26 +201,53 @@ class Shader {
         fragmentShaderFilepath(fragmentShaderFilepath) {
     compileShader();
     linkShader();
+    cacheUniformLocations();
   }
 
   void destroy() const {
+    if (boundProgram == program) boundProgram = NO_PROGRAM;
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
     glDeleteProgram(program);
   }
 
   // activate shader on the currect context
-  void activate() const { glUseProgram(program); }
+  void activate() const { useProgram(program); }
   // deactivate shader on the currect context
-  void deactivate() const { glUseProgram(0); }
+  void deactivate() const { useProgram(0); }
+
+  // location of given uniform variable, or element index of a uniform
+  // array. -1 if the uniform is not active.
+  GLint getUniformLocation(const std::string& uniformName,
+                           std::size_t index = 0) const {
+    if (!stateCaching) {
+      const std::string name =
+          index > 0 ? uniformName + "[" + std::to_string(index) + "]"
+                    : uniformName;
+      statistics.locationQueries++;
+      return glGetUniformLocation(program, name.c_str());
+    }
+
+    const auto it = uniformLocations.find(uniformName);
+    if (it == uniformLocations.end() || index >= it->second.size()) {
+      return -1;
+    }
+    return it->second[index];
+  }
 
   void setUniform(const std::string& uniformName,
-                  const std::variant<bool, GLint, GLuint, GLfloat, glm::vec2,
-                                     glm::vec3, glm::mat4>& value) const {
-    activate();
+                  const UniformValue& value) const {
+    setUniform(getUniformLocation(uniformName), value);
+  }
 
-    // get location of uniform variable
-    const GLint location = glGetUniformLocation(program, uniformName.c_str());
+  // set value of uniform at given location. the value is skipped when the
+  // uniform already holds it.
+  void setUniform(GLint location, const UniformValue& value) const {
+    if (location < 0) return;
+    if (stateCaching && uniformValues[location] == value) return;
+    uniformValues[location] = value;
+
+    activate();
 
     // set value
     struct Visitor {
@@ -164,28 +269,67 @@ class Shader {
       }
     };
     std::visit(Visitor{location}, value);
+    statistics.uniformUpdates++;
 
-    deactivate();
+    if (!stateCaching) deactivate();
   }
 
   void setUniformTexture(const std::string& uniformName, GLuint texture,
-                         GLuint textureUnitNumber) const {
-    activate();
+                         GLuint textureUnitNumber,
+                         GLenum target = GL_TEXTURE_2D) const {
+    setUniformTexture(getUniformLocation(uniformName), texture,
+                      textureUnitNumber, target);
+  }
 
-    // bind texture to specified texture unit
+  // bind texture to given texture unit and point sampler at given location
+  // to it
+  void setUniformTexture(GLint location, GLuint texture,
+                         GLuint textureUnitNumber,
+                         GLenum target = GL_TEXTURE_2D) const {
+    bindTexture(texture, textureUnitNumber, target);
+    setUniform(location, static_cast<GLint>(textureUnitNumber));
+  }
+
+  // bind texture to given texture unit, unless it is already bound. a unit
+  // is expected to be used with a single target.
+  static void bindTexture(GLuint texture, GLuint textureUnitNumber,
+                          GLenum target = GL_TEXTURE_2D) {
+    if (stateCaching) {
+      if (textureUnitNumber >= boundTextures.size()) {
+        boundTextures.resize(textureUnitNumber + 1, NO_TEXTURE);
+      }
+      if (boundTextures[textureUnitNumber] == texture) return;
+      boundTextures[textureUnitNumber] = texture;
+    }
     glActiveTexture(GL_TEXTURE0 + textureUnitNumber);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindTexture(target, texture);
+    statistics.textureBinds += 2;
+  }
 
-    // set texture unit number on uniform variable
-    const GLint location = glGetUniformLocation(program, uniformName.c_str());
-    glUniform1i(location, textureUnitNumber);
+  // skip program binds, location queries, uniform updates and texture
+  // binds which do not change GL state. disabling it binds and unbinds the
+  // program around every uniform update and looks up every location.
+  static bool getStateCaching() { return stateCaching; }
+  static void setStateCaching(bool stateCaching) {
+    Shader::stateCaching = stateCaching;
+    invalidateState();
+  }
 
-    deactivate();
+  // forget the bound program and textures. must be called after GL state
+  // was changed behind Shader, e.g. by texture uploads or the UI renderer.
+  static void invalidateState() {
+    boundProgram = NO_PROGRAM;
+    boundTextures.clear();
   }
 
+  static const ShaderStatistics& getStatistics() { return statistics; }
+  static void resetStatistics() { statistics = ShaderStatistics(); }
+
   void setUBO(const std::string& blockName, GLuint bindingNumber) const {
     const GLuint blockIndex =
         glGetUniformBlockIndex(program, blockName.c_str());
+    // block is optimized away when unused
+    if (blockIndex == GL_INVALID_INDEX) return;
 
     // set binding number of specified block
     glUniformBlockBinding(program, blockIndex, bindingNumber);
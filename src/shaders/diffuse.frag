@@ -2,25 +2,31 @@
 in vec3 position;
 in vec3 normal;
 in vec2 texCoords;
+flat in uint drawMaterialIndex;
 
 out vec4 fragColor;
 
-uniform vec3 kd;
-uniform vec3 ks;
-uniform vec3 ka;
-uniform float shininess;
+struct Material {
+  vec4 kd;  // w: shininess
+  vec4 ks;  // w: layer of diffuse texture, -1 if none
+  vec4 ka;  // w: layer of specular texture, -1 if none
+};
 
-uniform sampler2D diffuseTextures[100];
-uniform sampler2D specularTextures[100];
+// materials of the bound window, selected by the material index of the draw
+layout(std140) uniform MaterialBlock {
+  Material materials[256];
+};
 
-uniform bool hasDiffuseTextures;
-uniform bool hasSpecularTextures;
+// texture arrays holding the textures of the material
+uniform sampler2DArray diffuseTextures;
+uniform sampler2DArray specularTextures;
 
 void main() {
-  if(hasDiffuseTextures) {
-    fragColor = texture(diffuseTextures[0], texCoords);
+  Material material = materials[drawMaterialIndex];
+  if(material.ks.w >= 0.0) {
+    fragColor = texture(diffuseTextures, vec3(texCoords, material.ks.w));
   }
   else {
-    fragColor = vec4(kd, 1.0);
+    fragColor = vec4(material.kd.xyz, 1.0);
   }
 }
\ No newline at end of file
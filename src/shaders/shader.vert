@@ -2,19 +2,79 @@
 layout (location = 0) in vec3 vPosition;
 layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 vTexCoords;
+layout (location = 3) in vec2 vOctahedralNormal;
+layout (location = 4) in uint vDrawID;
 
 out vec3 position;
 out vec3 normal;
 out vec2 texCoords;
+flat out uint drawMaterialIndex;  // in the bound material window
 
 layout(std140) uniform CameraBlock {
   mat4 view;
   mat4 projection;
 };
 
+// vertex decoding of compact vertex formats
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
+
+// material of the draw, in the bound material window
+uniform uint materialIndex;
+
+// transforms of mesh instances, 6 texels per instance holding the rows of
+// an affine world matrix, then the rows of its normal matrix
+uniform samplerBuffer transforms;
+uniform int firstInstance;
+// instance of each slot. meshes list their visible instances at the front
+// of their range of slots.
+uniform usamplerBuffer visibleInstances;
+
+// per-draw data of multi-draw indirect rendering, 3 texels per draw
+uniform bool useDrawData;
+uniform samplerBuffer drawData;
+
+vec3 decodeOctahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  float t = max(-n.z, 0.0);
+  n.x += n.x >= 0.0 ? -t : t;
+  n.y += n.y >= 0.0 ? -t : t;
+  return normalize(n);
+}
+
 void main() {
-  gl_Position = projection * view * vec4(vPosition, 1.0);
-  position = vPosition;
-  normal = vNormal;
+  vec3 offset = positionOffset;
+  vec3 scale = positionScale;
+  bool octahedral = octahedralNormals;
+  int instance = firstInstance;
+  drawMaterialIndex = materialIndex;
+  if(useDrawData) {
+    vec4 offsetTexel = texelFetch(drawData, int(vDrawID) * 3 + 0);
+    offset = offsetTexel.xyz;
+    octahedral = offsetTexel.w > 0.5;
+    vec4 scaleTexel = texelFetch(drawData, int(vDrawID) * 3 + 1);
+    scale = scaleTexel.xyz;
+    drawMaterialIndex = uint(scaleTexel.w);
+    instance = int(texelFetch(drawData, int(vDrawID) * 3 + 2).x);
+  }
+  instance = int(texelFetch(visibleInstances, instance + gl_InstanceID).r);
+
+  // rows of the world transform become columns of the mat4
+  mat4 world = transpose(mat4(texelFetch(transforms, instance * 6 + 0),
+                              texelFetch(transforms, instance * 6 + 1),
+                              texelFetch(transforms, instance * 6 + 2),
+                              vec4(0.0, 0.0, 0.0, 1.0)));
+  mat3 normalMatrix =
+      transpose(mat3(texelFetch(transforms, instance * 6 + 3).xyz,
+                     texelFetch(transforms, instance * 6 + 4).xyz,
+                     texelFetch(transforms, instance * 6 + 5).xyz));
+
+  vec3 p = (world * vec4(offset + scale * vPosition, 1.0)).xyz;
+  gl_Position = projection * view * vec4(p, 1.0);
+  position = p;
+  vec3 n = normalMatrix *
+      (octahedral ? decodeOctahedral(vOctahedralNormal) : vNormal);
+  normal = dot(n, n) > 0.0 ? normalize(n) : n;
   texCoords = vTexCoords;
 }
\ No newline at end of file
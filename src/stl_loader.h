@@ -0,0 +1,290 @@
+#ifndef _STL_LOADER_H
+#define _STL_LOADER_H
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "bounds.h"
+#include "glm/glm.hpp"
+#include "mapped_file.h"
+#include "mesh.h"
+#include "mesh_normals.h"
+#include "thread_pool.h"
+#include "vertex_format.h"
+
+// native loader of binary STL files. STL stores three positions per
+// triangle, so corners at the same position are welded into shared
+// vertices, which then get smooth normals instead of the face normals of
+// the file.
+//
+// the file is memory-mapped and read in place. corners in the same cell of
+// a grid with cells WELD_TOLERANCE times the largest extent of the model
+// are welded: corners are bucketed by cell hash into partitions, and each
+// partition is welded with its own hash table on a worker thread. the
+// first corner of a cell becomes its vertex, so the result does not depend
+// on the number of threads. besides the index buffer, only one index per
+// corner is kept while welding. follows the contract in native_loader.h.
+class StlLoader {
+ public:
+  // load given STL file. ASCII files are rejected.
+  static std::optional<MeshData> load(const std::string& filepath,
+                                      std::atomic<float>& progress,
+                                      const std::atomic<bool>& cancelled) {
+    MappedFile file;
+    if (!file.open(filepath) || file.size() < HEADER_SIZE) {
+      return std::nullopt;
+    }
+
+    // binary STL has the size given by its triangle count. ASCII STL
+    // starts with "solid", but so do some binary files.
+    const unsigned char* const data = file.data();
+    std::uint32_t nTriangles;
+    std::memcpy(&nTriangles, data + HEADER_SIZE - 4, 4);
+    const std::size_t expectedSize =
+        HEADER_SIZE + std::size_t(nTriangles) * TRIANGLE_SIZE;
+    if (nTriangles == 0 || nTriangles > MAX_TRIANGLES ||
+        file.size() < expectedSize ||
+        (file.size() != expectedSize &&
+         std::memcmp(data, "solid", 5) == 0)) {
+      return std::nullopt;
+    }
+    const Triangles triangles{data + HEADER_SIZE};
+    const std::size_t nCorners = 3 * std::size_t(nTriangles);
+    const std::size_t nBlocks = (nCorners + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    ThreadPool& pool = ThreadPool::shared();
+
+    // bounds of all corners, which define the welding grid
+    std::vector<Bounds> blockBounds(nBlocks);
+    std::atomic<bool> finite{true};
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      Bounds& bounds = blockBounds[b];
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        const glm::vec3 p = triangles.position(c);
+        if (!std::isfinite(p.x) || !std::isfinite(p.y) ||
+            !std::isfinite(p.z)) {
+          finite = false;
+          return;
+        }
+        bounds.min = glm::min(bounds.min, p);
+        bounds.max = glm::max(bounds.max, p);
+      }
+    });
+    if (!finite) return std::nullopt;
+    Bounds bounds;
+    for (const auto& block : blockBounds) bounds.merge(block);
+    const glm::vec3 size = bounds.max - bounds.min;
+    const float extent = std::max({size.x, size.y, size.z});
+    const Grid grid{bounds.min,
+                    extent > 0.0f ? 1.0f / (extent * WELD_TOLERANCE) : 1.0f};
+    progress = 0.1f;
+    if (cancelled) return std::nullopt;
+
+    // bucket corners by partition, keeping their order
+    const int partitionBits =
+        nCorners >= MIN_PARTITIONED_CORNERS ? PARTITION_BITS : 0;
+    const std::size_t nPartitions = std::size_t(1) << partitionBits;
+    const auto partitionOf = [&](std::uint64_t hash) {
+      return partitionBits > 0
+                 ? static_cast<std::size_t>(hash >> (64 - partitionBits))
+                 : 0;
+    };
+    std::vector<std::uint32_t> offsets(nBlocks * nPartitions, 0);
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      std::uint32_t* counts = &offsets[b * nPartitions];
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        counts[partitionOf(hash(grid.cell(triangles.position(c))))]++;
+      }
+    });
+    std::vector<std::uint32_t> partitionStarts(nPartitions + 1, 0);
+    std::uint32_t offset = 0;
+    for (std::size_t p = 0; p < nPartitions; ++p) {
+      partitionStarts[p] = offset;
+      for (std::size_t b = 0; b < nBlocks; ++b) {
+        const std::uint32_t count = offsets[b * nPartitions + p];
+        offsets[b * nPartitions + p] = offset;
+        offset += count;
+      }
+    }
+    partitionStarts[nPartitions] = offset;
+    std::vector<std::uint32_t> order(nCorners);
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      std::uint32_t* cursors = &offsets[b * nPartitions];
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        const std::uint64_t h = hash(grid.cell(triangles.position(c)));
+        order[cursors[partitionOf(h)]++] = static_cast<std::uint32_t>(c);
+      }
+    });
+    offsets = {};
+    if (cancelled) return std::nullopt;
+
+    // weld partitions. indices[c] becomes the first corner of the cell of
+    // corner c.
+    MeshData mesh;
+    std::vector<unsigned int>& indices = mesh.indices;
+    indices.resize(nCorners);
+    std::atomic<std::size_t> nWelded{0};
+    pool.parallelFor(nPartitions, [&](std::size_t p) {
+      if (cancelled) return;
+      weldPartition(&order[partitionStarts[p]],
+                    partitionStarts[p + 1] - partitionStarts[p],
+                    partitionBits, triangles, grid, indices);
+      progress = 0.1f + 0.2f * (nWelded.fetch_add(1) + 1) / nPartitions;
+    });
+    order = {};
+    if (cancelled) return std::nullopt;
+
+    // number vertices in order of their first corners. vertex indices are
+    // flagged until every corner has looked up the index of its vertex.
+    std::vector<std::uint32_t> blockStarts(nBlocks + 1, 0);
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      std::uint32_t count = 0;
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        count += indices[c] == c;
+      }
+      blockStarts[b + 1] = count;
+    });
+    for (std::size_t b = 0; b < nBlocks; ++b) {
+      blockStarts[b + 1] += blockStarts[b];
+    }
+    std::vector<Vertex>& vertices = mesh.vertices;
+    vertices.resize(blockStarts[nBlocks]);
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      std::uint32_t vertex = blockStarts[b];
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        if (indices[c] != c) continue;
+        vertices[vertex].position = triangles.position(c);
+        vertices[vertex].texcoords = glm::vec2(0.0f);
+        indices[c] = vertex++ | VERTEX_FLAG;
+      }
+    });
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        if (!(indices[c] & VERTEX_FLAG)) {
+          indices[c] = indices[indices[c]] & ~VERTEX_FLAG;
+        }
+      }
+    });
+    pool.parallelFor(nBlocks, [&](std::size_t b) {
+      const std::size_t end = std::min(nCorners, (b + 1) * BLOCK_SIZE);
+      for (std::size_t c = b * BLOCK_SIZE; c < end; ++c) {
+        indices[c] &= ~VERTEX_FLAG;
+      }
+    });
+    progress = 0.4f;
+    if (cancelled) return std::nullopt;
+
+    MeshNormals::computeSmooth(vertices, indices);
+    mesh.bounds = Bounds::compute(vertices.data(), vertices.size());
+    // defaults of assimp's STL importer
+    mesh.material = Material{glm::vec3(0.6f), glm::vec3(0.6f),
+                             glm::vec3(0.05f), 0.0f};
+
+    progress = 0.5f;
+    return mesh;
+  }
+
+ private:
+  // 80 bytes of text, then the triangle count
+  static constexpr std::size_t HEADER_SIZE = 84;
+  // normal, three positions and a 16-bit attribute
+  static constexpr std::size_t TRIANGLE_SIZE = 50;
+  // corners and vertices are addressed by 31-bit indices, leaving the top
+  // bit to flag vertex indices
+  static constexpr std::size_t MAX_TRIANGLES = 0x7fffffff / 3;
+  static constexpr std::uint32_t VERTEX_FLAG = 0x80000000u;
+  // welding grid cell size relative to the largest model extent
+  static constexpr float WELD_TOLERANCE = 1.0f / (1 << 20);
+  static constexpr std::size_t BLOCK_SIZE = 1 << 16;
+  static constexpr int PARTITION_BITS = 8;
+  static constexpr std::size_t WELD_BATCH_SIZE = 32;
+  static constexpr std::size_t MIN_PARTITIONED_CORNERS = 1 << 20;
+  static constexpr std::uint64_t EMPTY = ~std::uint64_t(0);
+
+  // triangle records of the mapped file
+  struct Triangles {
+    const unsigned char* data;
+
+    glm::vec3 position(std::size_t corner) const {
+      glm::vec3 p;
+      std::memcpy(&p[0],
+                  data + corner / 3 * TRIANGLE_SIZE + 12 + corner % 3 * 12,
+                  12);
+      return p;
+    }
+  };
+
+  // welding grid. cells are packed into 21 bits per axis.
+  struct Grid {
+    glm::vec3 origin;
+    float scale;  // cells per unit
+
+    std::uint64_t cell(const glm::vec3& p) const {
+      const glm::vec3 q = glm::min((p - origin) * scale, glm::vec3(MAX_CELL));
+      // cells fit 32 bits, which convert faster than 64 bits
+      return std::uint64_t(static_cast<std::uint32_t>(q.x)) |
+             std::uint64_t(static_cast<std::uint32_t>(q.y)) << 21 |
+             std::uint64_t(static_cast<std::uint32_t>(q.z)) << 42;
+    }
+
+    static constexpr float MAX_CELL = (1 << 21) - 1;
+  };
+
+  // Fibonacci hashing. partitions use the top bits and tables the bits
+  // below.
+  static std::uint64_t hash(std::uint64_t cell) {
+    return cell * 0x9E3779B97F4A7C15ull;
+  }
+
+  // weld given corners, which are sorted and hash to one partition, with an
+  // open addressing table of cells and their first corners
+  static void weldPartition(const std::uint32_t* corners, std::size_t n,
+                            int partitionBits, const Triangles& triangles,
+                            const Grid& grid,
+                            std::vector<unsigned int>& indices) {
+    // at most half full
+    int tableBits = 4;
+    while ((std::size_t(1) << tableBits) < 2 * n) tableBits++;
+    const std::size_t capacity = std::size_t(1) << tableBits;
+    const int tableShift = 64 - partitionBits - tableBits;
+    const std::size_t mask = capacity - 1;
+    std::vector<std::uint64_t> cells(capacity, EMPTY);
+    std::vector<std::uint32_t> firstCorners(capacity);
+
+    // corners are spread over the file, so cells are computed in batches
+    // whose loads can miss the cache at the same time
+    std::uint64_t batch[WELD_BATCH_SIZE];
+    for (std::size_t first = 0; first < n; first += WELD_BATCH_SIZE) {
+      const std::size_t batchSize = std::min(n - first, WELD_BATCH_SIZE);
+      for (std::size_t i = 0; i < batchSize; ++i) {
+        batch[i] = grid.cell(triangles.position(corners[first + i]));
+      }
+      for (std::size_t i = 0; i < batchSize; ++i) {
+        const std::uint32_t corner = corners[first + i];
+        const std::uint64_t cell = batch[i];
+        std::size_t slot = (hash(cell) >> tableShift) & mask;
+        while (cells[slot] != EMPTY && cells[slot] != cell) {
+          slot = (slot + 1) & mask;
+        }
+        if (cells[slot] == EMPTY) {
+          cells[slot] = cell;
+          firstCorners[slot] = corner;
+        }
+        indices[corner] = firstCorners[slot];
+      }
+    }
+  }
+};
+
+#endif
@@ -1,5 +1,11 @@
 #ifndef _TEXTURE_H
 #define _TEXTURE_H
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <memory>
 #include <string>
 
 #include "glad/glad.h"
@@ -10,50 +16,221 @@ enum class TextureType {
   SPECULAR,
 };
 
-class Texture {
- public:
-  std::string filepath;
-  GLuint id;
-  TextureType textureType;
+// textures are grouped into texture arrays by size. resizing textures to
+// the most common size reduces the number of arrays.
+enum class TextureResizePolicy {
+  None,      // one array per size
+  Outliers,  // resize textures whose size is shared by at most two others
+  All,       // resize every texture, giving a single size
+};
 
-  Texture() {
-    glGenTextures(1, &id);
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_NEAREST_MIPMAP_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+// RGB image decoded on the CPU
+struct Image {
+  struct Deleter {
+    void operator()(unsigned char* pixels) const { stbi_image_free(pixels); }
+  };
+
+  int width = 0;
+  int height = 0;
+  std::unique_ptr<unsigned char[], Deleter> pixels;
+
+  operator bool() const { return pixels != nullptr; }
+
+  // decode image file. this does not touch GL, so it may run on any thread.
+  bool load(const std::string& filepath) {
+    int channels;
+    pixels.reset(stbi_load(filepath.c_str(), &width, &height, &channels, 3));
+
+    if (!pixels) {
+      std::cerr << "failed to open " << filepath << std::endl;
+      return false;
+    }
+    return true;
   }
-  Texture(const std::string& filepath, const TextureType& textureType)
-      : Texture() {
-    this->filepath = filepath;
-    this->textureType = textureType;
-    loadImage(filepath);
+
+  // decode image file already read into memory. filepath is only used for
+  // error messages.
+  bool loadFromMemory(const unsigned char* data, std::size_t size,
+                      const std::string& filepath) {
+    int channels;
+    pixels.reset();
+    if (size <= static_cast<std::size_t>(std::numeric_limits<int>::max())) {
+      pixels.reset(stbi_load_from_memory(data, static_cast<int>(size), &width,
+                                         &height, &channels, 3));
+    }
+
+    if (!pixels) {
+      std::cerr << "failed to decode " << filepath << std::endl;
+      return false;
+    }
+    return true;
   }
 
-  void destroy() { glDeleteTextures(1, &id); }
+  std::size_t getSize() const {
+    return pixels ? static_cast<std::size_t>(width) * height * 3 : 0;
+  }
 
-  void loadImage(const std::string& filepath) const {
-    // load image
-    int width, height, channels;
-    unsigned char* image =
-        stbi_load(filepath.c_str(), &width, &height, &channels, 3);
+  // resample image to given size. large reductions halve the image by box
+  // filtering first, so that bilinear filtering does not alias.
+  Image resized(int newWidth, int newHeight) const {
+    if (pixels && width >= 2 * newWidth && height >= 2 * newHeight) {
+      return halved().resized(newWidth, newHeight);
+    }
 
-    if (!image) {
-      std::cerr << "failed to open " << filepath << std::endl;
-      return;
+    Image image;
+    if (!pixels) return image;
+
+    // stb_image frees pixels with free()
+    image.width = newWidth;
+    image.height = newHeight;
+    image.pixels.reset(static_cast<unsigned char*>(
+        std::malloc(static_cast<std::size_t>(newWidth) * newHeight * 3)));
+
+    const float scaleX = static_cast<float>(width) / newWidth;
+    const float scaleY = static_cast<float>(height) / newHeight;
+    for (int y = 0; y < newHeight; ++y) {
+      const float sy = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+      const int y0 = std::min(static_cast<int>(sy), height - 1);
+      const int y1 = std::min(y0 + 1, height - 1);
+      const float ty = sy - y0;
+      for (int x = 0; x < newWidth; ++x) {
+        const float sx = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+        const int x0 = std::min(static_cast<int>(sx), width - 1);
+        const int x1 = std::min(x0 + 1, width - 1);
+        const float tx = sx - x0;
+        for (int c = 0; c < 3; ++c) {
+          const float p00 = pixels[3 * (y0 * width + x0) + c];
+          const float p01 = pixels[3 * (y0 * width + x1) + c];
+          const float p10 = pixels[3 * (y1 * width + x0) + c];
+          const float p11 = pixels[3 * (y1 * width + x1) + c];
+          const float p = (1.0f - ty) * ((1.0f - tx) * p00 + tx * p01) +
+                          ty * ((1.0f - tx) * p10 + tx * p11);
+          image.pixels[3 * (static_cast<std::size_t>(y) * newWidth + x) + c] =
+              static_cast<unsigned char>(p + 0.5f);
+        }
+      }
+    }
+    return image;
+  }
+
+ private:
+  // image of half size, averaging 2x2 pixels
+  Image halved() const {
+    Image image;
+    image.width = std::max(width / 2, 1);
+    image.height = std::max(height / 2, 1);
+    image.pixels.reset(static_cast<unsigned char*>(std::malloc(
+        static_cast<std::size_t>(image.width) * image.height * 3)));
+
+    for (int y = 0; y < image.height; ++y) {
+      const int y0 = std::min(2 * y, height - 1);
+      const int y1 = std::min(2 * y + 1, height - 1);
+      for (int x = 0; x < image.width; ++x) {
+        const int x0 = std::min(2 * x, width - 1);
+        const int x1 = std::min(2 * x + 1, width - 1);
+        for (int c = 0; c < 3; ++c) {
+          const int sum = pixels[3 * (y0 * width + x0) + c] +
+                          pixels[3 * (y0 * width + x1) + c] +
+                          pixels[3 * (y1 * width + x0) + c] +
+                          pixels[3 * (y1 * width + x1) + c];
+          image.pixels[3 * (static_cast<std::size_t>(y) * image.width + x) +
+                       c] = static_cast<unsigned char>((sum + 2) / 4);
+        }
+      }
     }
+    return image;
+  }
+};
+
+// texture decoded on the CPU, ready to be uploaded to the GPU
+struct TextureData {
+  static constexpr std::uint32_t UNIQUE = ~0u;
+
+  std::string filepath;
+  TextureType textureType;
+  Image image;
+  // earlier texture with the same file content, which is decoded instead
+  std::uint32_t duplicateOf = UNIQUE;
+};
+
+// location of a texture in the texture arrays of a model
+struct TextureLayer {
+  static constexpr std::uint32_t NO_ARRAY = ~0u;
+
+  std::uint32_t array = NO_ARRAY;  // NO_ARRAY for missing textures
+  std::uint32_t layer = 0;
+
+  operator bool() const { return array != NO_ARRAY; }
+};
+
+// size of a texture array to be allocated
+struct TextureArrayLayout {
+  int width = 0;
+  int height = 0;
+  int layers = 0;
+};
 
-    // send image to texture
-    glBindTexture(GL_TEXTURE_2D, id);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-                 GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
+// RGB texture array whose layers share size and mipmap chain
+class TextureArray {
+ public:
+  // every GL 3.3 implementation supports at least this many layers
+  static constexpr int MAX_LAYERS = 256;
+
+  GLuint id = 0;
+  int width = 0;
+  int height = 0;
+  int layers = 0;
+
+  // allocate storage of given size. uses immutable storage when
+  // GL_ARB_texture_storage is available.
+  void allocate(int width, int height, int layers) {
+    this->width = width;
+    this->height = height;
+    this->layers = layers;
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_NEAREST_MIPMAP_LINEAR);
+    if (GLAD_GL_ARB_texture_storage) {
+      int levels = 1;
+      while ((std::max(width, height) >> levels) > 0) {
+        levels++;
+      }
+      glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGB8, width, height,
+                     layers);
+    } else {
+      // other levels are allocated by generateMipmaps()
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, layers, 0,
+                   GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  // replace base level of given layer. pixels is an offset when a pixel
+  // unpack buffer is bound.
+  void setLayer(int layer, const void* pixels) const {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1,
+                    GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
+
+  // regenerate mipmaps of every layer after their base levels were set
+  void generateMipmaps() const {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  }
 
-    stbi_image_free(image);
+  void destroy() {
+    if (id) glDeleteTextures(1, &id);
+    id = 0;
   }
 };
 
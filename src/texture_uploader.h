@@ -0,0 +1,172 @@
+#ifndef _TEXTURE_UPLOADER_H
+#define _TEXTURE_UPLOADER_H
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "glad/glad.h"
+#include "texture.h"
+#include "thread_pool.h"
+
+// streams decoded images into layers of texture arrays through a ring of
+// persistently mapped pixel buffers. worker threads copy pixels into the
+// mapped ring, and each slot is recycled once the fence of its last upload
+// has signaled, so no upload waits for the GPU unless the ring is full.
+// falls back to uploading from client memory when GL_ARB_buffer_storage or
+// GL_ARB_texture_storage is not available.
+class TextureUploader {
+ public:
+  TextureUploader(std::size_t slotSize = 32 << 20, std::size_t nSlots = 3)
+      : slotSize(slotSize), fences(nSlots, nullptr) {}
+
+  static bool isSupported() {
+    return GLAD_GL_ARB_buffer_storage && GLAD_GL_ARB_texture_storage;
+  }
+
+  // upload image of data[i] to layers[i] of allocated arrays and generate
+  // their mipmaps. decoded pixels are released once they have been copied.
+  void upload(const std::vector<TextureArray>& arrays,
+              const std::vector<TextureLayer>& layers,
+              std::vector<TextureData>& data) {
+    // images without a layer are not uploaded
+    for (std::size_t i = 0; i < data.size(); ++i) {
+      if (!layers[i]) data[i].image.pixels.reset();
+    }
+
+    if (!isSupported() || (!PBO && !createRing())) {
+      for (std::size_t i = 0; i < data.size(); ++i) {
+        if (!data[i].image) continue;
+        arrays[layers[i].array].setLayer(layers[i].layer,
+                                         data[i].image.pixels.get());
+        data[i].image.pixels.reset();
+      }
+      generateMipmaps(arrays);
+      return;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+
+    std::size_t i = 0;
+    while (i < data.size()) {
+      // images larger than a slot are uploaded from client memory
+      if (imageSize(data[i].image) > slotSize) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        arrays[layers[i].array].setLayer(layers[i].layer,
+                                         data[i].image.pixels.get());
+        data[i].image.pixels.reset();
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+        i++;
+        continue;
+      }
+
+      // pack as many images as fit into next slot
+      std::size_t end = i;
+      std::size_t batchSize = 0;
+      std::vector<std::size_t> offsets;
+      while (end < data.size()) {
+        const std::size_t size = imageSize(data[end].image);
+        if (size > slotSize || batchSize + size > slotSize) break;
+        offsets.push_back(batchSize);
+        batchSize += size;
+        end++;
+      }
+
+      const std::size_t slot = nextSlot;
+      nextSlot = (nextSlot + 1) % fences.size();
+      waitSlot(slot);
+
+      // copy pixels into the mapped slot on worker threads
+      unsigned char* slotMemory = mapped + slot * slotSize;
+      ThreadPool::shared().parallelFor(end - i, [&](std::size_t j) {
+        const Image& image = data[i + j].image;
+        if (!image) return;
+        std::memcpy(slotMemory + offsets[j], image.pixels.get(),
+                    imageSize(image));
+      });
+
+      // upload from the slot
+      for (std::size_t j = i; j < end; ++j) {
+        if (!data[j].image) continue;
+        const std::size_t offset = slot * slotSize + offsets[j - i];
+        arrays[layers[j].array].setLayer(layers[j].layer,
+                                         reinterpret_cast<void*>(offset));
+        data[j].image.pixels.reset();
+      }
+      fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+      i = end;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    generateMipmaps(arrays);
+  }
+
+  void destroy() {
+    for (auto& fence : fences) {
+      if (fence) glDeleteSync(fence);
+      fence = nullptr;
+    }
+    if (PBO) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &PBO);
+    }
+    PBO = 0;
+    mapped = nullptr;
+  }
+
+ private:
+  std::size_t slotSize;
+  std::vector<GLsync> fences;  // fence of last upload from each slot
+  std::size_t nextSlot = 0;
+  GLuint PBO = 0;
+  unsigned char* mapped = nullptr;
+
+  static void generateMipmaps(const std::vector<TextureArray>& arrays) {
+    for (const auto& array : arrays) {
+      array.generateMipmaps();
+    }
+  }
+
+  static std::size_t imageSize(const Image& image) {
+    return image ? static_cast<std::size_t>(image.width) * image.height * 3
+                 : 0;
+  }
+
+  bool createRing() {
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    const GLsizeiptr size = slotSize * fences.size();
+
+    glGenBuffers(1, &PBO);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, nullptr, flags);
+    mapped = static_cast<unsigned char*>(
+        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (!mapped) {
+      std::cerr << "[TextureUploader] failed to map pixel buffer" << std::endl;
+      destroy();
+      return false;
+    }
+    return true;
+  }
+
+  // wait until the GPU has consumed the previous upload from given slot
+  void waitSlot(std::size_t slot) {
+    GLsync& fence = fences[slot];
+    if (!fence) return;
+
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    while (result == GL_TIMEOUT_EXPIRED) {
+      result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+};
+
+#endif
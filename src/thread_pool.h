@@ -0,0 +1,135 @@
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ public:
+  // spawn given number of worker threads(hardware concurrency by default)
+  ThreadPool(std::size_t nThreads = std::thread::hardware_concurrency()) {
+    nThreads = std::max(nThreads, static_cast<std::size_t>(1));
+    for (std::size_t i = 0; i < nThreads; ++i) {
+      workers.emplace_back([this] { workerLoop(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  // pool shared by the whole application
+  static ThreadPool& shared() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  std::size_t getNumThreads() const { return workers.size(); }
+
+  // run given task on a worker thread
+  template <typename F>
+  std::future<void> submit(F&& f) {
+    auto task =
+        std::make_shared<std::packaged_task<void()>>(std::forward<F>(f));
+    std::future<void> future = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([task] { (*task)(); });
+    }
+    condition.notify_one();
+    return future;
+  }
+
+  // call f(i) for every i in [0, n) and wait for all of them.
+  // the calling thread takes part in the work, so this may be called from
+  // inside a task without deadlocking the pool.
+  template <typename F>
+  void parallelFor(std::size_t n, F&& f) {
+    if (n == 0) return;
+
+    struct State {
+      std::atomic<std::size_t> next{0};
+      std::atomic<std::size_t> done{0};
+      std::size_t n;
+      std::function<void(std::size_t)> f;
+      std::exception_ptr exception;
+      std::mutex mutex;
+      std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+    state->n = n;
+    state->f = std::forward<F>(f);
+
+    const auto run = [](State& s) {
+      std::size_t i;
+      while ((i = s.next.fetch_add(1)) < s.n) {
+        try {
+          s.f(i);
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(s.mutex);
+          if (!s.exception) s.exception = std::current_exception();
+        }
+        if (s.done.fetch_add(1) + 1 == s.n) {
+          std::lock_guard<std::mutex> lock(s.mutex);
+          s.finished.notify_all();
+        }
+      }
+    };
+
+    const std::size_t nHelpers = std::min(workers.size(), n - 1);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (std::size_t i = 0; i < nHelpers; ++i) {
+        tasks.emplace([state, run] { run(*state); });
+      }
+    }
+    condition.notify_all();
+
+    run(*state);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done.load() == n; });
+    if (state->exception) std::rethrow_exception(state->exception);
+  }
+
+ private:
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool stopping = false;
+
+  void workerLoop() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+        if (stopping && tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      task();
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef _TRANSFORM_BUFFER_H
+#define _TRANSFORM_BUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "scene_graph.h"
+#include "shader.h"
+
+// world transform of a mesh instance and the matrix transforming its
+// normals, both stored as rows
+struct InstanceTransform {
+  AffineTransform world;
+  glm::vec4 normalRows[3];
+
+  // the normal matrix is the cofactor matrix of the upper 3x3 of world,
+  // which is its inverse transpose scaled by the determinant. the shader
+  // normalizes normals, so the scale does not matter, and unlike the
+  // inverse the cofactor matrix exists for singular transforms: meshes
+  // flattened to a plane keep the normal of that plane, and meshes
+  // collapsed further get zero normals.
+  static InstanceTransform fromWorld(const AffineTransform& world) {
+    const glm::vec3 r0(world.rows[0]);
+    const glm::vec3 r1(world.rows[1]);
+    const glm::vec3 r2(world.rows[2]);
+    const glm::vec3 c0 = glm::cross(r1, r2);
+    const glm::vec3 c1 = glm::cross(r2, r0);
+    const glm::vec3 c2 = glm::cross(r0, r1);
+    // the determinant is negative for mirroring transforms, which would
+    // turn normals inside
+    const float sign = glm::dot(r0, c0) < 0.0f ? -1.0f : 1.0f;
+
+    // the cross products are the rows of the cofactor matrix, since
+    // dot(rows[i], ci) is the determinant for i and 0 otherwise
+    InstanceTransform transform;
+    transform.world = world;
+    transform.normalRows[0] = glm::vec4(sign * c0, 0.0f);
+    transform.normalRows[1] = glm::vec4(sign * c1, 0.0f);
+    transform.normalRows[2] = glm::vec4(sign * c2, 0.0f);
+    return transform;
+  }
+};
+
+// transforms of every mesh instance in one buffer texture, six texels per
+// instance holding the rows of its InstanceTransform.
+//
+// a second buffer texture lists the instances left visible by culling: each
+// mesh owns the slots of its range of instances and lists its visible
+// instances at the front, so instance counts change per frame while the
+// ranges stay fixed. the vertex shader fetches the transform of the
+// instance in slot firstInstance + gl_InstanceID.
+class TransformBuffer {
+ public:
+  // texture units of the buffer textures. DRAW_DATA_UNIT is 15.
+  static constexpr GLint TRANSFORM_UNIT = 14;
+  static constexpr GLint VISIBLE_INSTANCE_UNIT = 13;
+
+  static void setupShader(const Shader& shader) {
+    shader.setUniform("transforms", TRANSFORM_UNIT);
+    shader.setUniform("visibleInstances", VISIBLE_INSTANCE_UNIT);
+  }
+
+  // upload transforms, reusing the storage when the count is unchanged
+  void setTransforms(const std::vector<InstanceTransform>& transforms) {
+    transformTexture.set(transforms.data(),
+                         transforms.size() * sizeof(InstanceTransform),
+                         GL_RGBA32F, GL_DYNAMIC_DRAW);
+  }
+
+  // upload instance index of every slot, written after culling each frame
+  void setVisibleInstances(const std::vector<std::uint32_t>& instances) {
+    visibleInstanceTexture.set(instances.data(),
+                               instances.size() * sizeof(std::uint32_t),
+                               GL_R32UI, GL_STREAM_DRAW);
+  }
+
+  void bind() const {
+    Shader::bindTexture(transformTexture.texture, TRANSFORM_UNIT,
+                        GL_TEXTURE_BUFFER);
+    Shader::bindTexture(visibleInstanceTexture.texture,
+                        VISIBLE_INSTANCE_UNIT, GL_TEXTURE_BUFFER);
+  }
+
+  void destroy() {
+    transformTexture.destroy();
+    visibleInstanceTexture.destroy();
+  }
+
+ private:
+  // buffer texture reusing its storage when the size is unchanged
+  struct BufferTexture {
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    std::size_t size = 0;  // bytes of buffer storage
+
+    void set(const void* data, std::size_t bytes, GLenum format,
+             GLenum usage) {
+      if (!buffer) {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+      }
+
+      glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+      if (bytes == size) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, data);
+      } else {
+        glBufferData(GL_TEXTURE_BUFFER, bytes, data, usage);
+        size = bytes;
+      }
+      glBindBuffer(GL_TEXTURE_BUFFER, 0);
+      glBindTexture(GL_TEXTURE_BUFFER, texture);
+      glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void destroy() {
+      if (buffer) {
+        glDeleteBuffers(1, &buffer);
+        glDeleteTextures(1, &texture);
+      }
+      buffer = 0;
+      texture = 0;
+      size = 0;
+    }
+  };
+
+  BufferTexture transformTexture;
+  BufferTexture visibleInstanceTexture;
+};
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef _VERTEX_FORMAT_H
+#define _VERTEX_FORMAT_H
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "glad/glad.h"
+#include "glm/glm.hpp"
+#include "thread_pool.h"
+
+struct Vertex {
+  glm::vec3 position;   // vertex position
+  glm::vec3 normal;     // vertex normal
+  glm::vec2 texcoords;  // texture coordinates
+};
+
+// layout of vertices on the GPU
+enum class VertexFormat {
+  Float,             // 32 bytes: Vertex as is
+  Compact,           // 20 bytes: float position, octahedral normal, half uv
+  CompactQuantized,  // 16 bytes: unorm16 position relative to mesh bounds
+};
+
+// vertex attribute locations shared with shader.vert
+constexpr GLuint POSITION_LOCATION = 0;
+constexpr GLuint NORMAL_LOCATION = 1;
+constexpr GLuint TEXCOORDS_LOCATION = 2;
+constexpr GLuint OCTAHEDRAL_NORMAL_LOCATION = 3;
+constexpr GLuint DRAW_ID_LOCATION = 4;
+
+struct CompactVertex {
+  glm::vec3 position;
+  std::int16_t normal[2];      // snorm16 octahedral normal
+  std::uint16_t texcoords[2];  // half float
+};
+
+struct QuantizedVertex {
+  std::uint16_t position[4];   // unorm16, w is padding
+  std::int16_t normal[2];      // snorm16 octahedral normal
+  std::uint16_t texcoords[2];  // half float
+};
+
+// converts vertices into a VertexFormat and sets up matching attributes
+class VertexPacker {
+ public:
+  // position = offset + scale * stored position
+  struct Dequantization {
+    glm::vec3 offset{0.0f};
+    glm::vec3 scale{1.0f};
+  };
+
+  static std::size_t getVertexSize(VertexFormat format) {
+    switch (format) {
+      case VertexFormat::Float:
+        return sizeof(Vertex);
+      case VertexFormat::Compact:
+        return sizeof(CompactVertex);
+      case VertexFormat::CompactQuantized:
+        return sizeof(QuantizedVertex);
+    }
+    return sizeof(Vertex);
+  }
+
+  static const char* getName(VertexFormat format) {
+    switch (format) {
+      case VertexFormat::Float:
+        return "float";
+      case VertexFormat::Compact:
+        return "compact";
+      case VertexFormat::CompactQuantized:
+        return "compact quantized";
+    }
+    return "";
+  }
+
+  // pack vertices into given format. Float needs no conversion and returns
+  // an empty buffer.
+  static std::vector<unsigned char> pack(VertexFormat format,
+                                         const Vertex* vertices,
+                                         std::size_t nVertices,
+                                         Dequantization& dequantization) {
+    dequantization = Dequantization();
+    std::vector<unsigned char> packed;
+    if (format == VertexFormat::Float) return packed;
+
+    packed.resize(nVertices * getVertexSize(format));
+
+    if (format == VertexFormat::CompactQuantized && nVertices > 0) {
+      glm::vec3 pMin = vertices[0].position;
+      glm::vec3 pMax = vertices[0].position;
+      for (std::size_t i = 1; i < nVertices; ++i) {
+        pMin = glm::min(pMin, vertices[i].position);
+        pMax = glm::max(pMax, vertices[i].position);
+      }
+      dequantization.offset = pMin;
+      dequantization.scale = pMax - pMin;
+      for (int k = 0; k < 3; ++k) {
+        if (dequantization.scale[k] <= 0.0f) dequantization.scale[k] = 1.0f;
+      }
+    }
+
+    // convert in chunks on worker threads
+    constexpr std::size_t CHUNK_SIZE = 1 << 16;
+    const std::size_t nChunks = (nVertices + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    ThreadPool::shared().parallelFor(nChunks, [&](std::size_t chunk) {
+      const std::size_t begin = chunk * CHUNK_SIZE;
+      const std::size_t end = std::min(begin + CHUNK_SIZE, nVertices);
+      for (std::size_t i = begin; i < end; ++i) {
+        const Vertex& v = vertices[i];
+        if (format == VertexFormat::Compact) {
+          CompactVertex c;
+          c.position = v.position;
+          encodeOctahedral(v.normal, c.normal);
+          c.texcoords[0] = toHalf(v.texcoords.x);
+          c.texcoords[1] = toHalf(v.texcoords.y);
+          std::memcpy(&packed[i * sizeof(CompactVertex)], &c, sizeof(c));
+        } else {
+          QuantizedVertex q;
+          for (int k = 0; k < 3; ++k) {
+            const float t = (v.position[k] - dequantization.offset[k]) /
+                            dequantization.scale[k];
+            q.position[k] = static_cast<std::uint16_t>(
+                std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+          }
+          q.position[3] = 0;
+          encodeOctahedral(v.normal, q.normal);
+          q.texcoords[0] = toHalf(v.texcoords.x);
+          q.texcoords[1] = toHalf(v.texcoords.y);
+          std::memcpy(&packed[i * sizeof(QuantizedVertex)], &q, sizeof(q));
+        }
+      }
+    });
+
+    return packed;
+  }
+
+  // set up attributes of the bound VAO for the bound VBO
+  static void setupAttributes(VertexFormat format) {
+    switch (format) {
+      case VertexFormat::Float: {
+        // position
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE,
+                              sizeof(Vertex), reinterpret_cast<void*>(0));
+        // normal
+        glEnableVertexAttribArray(NORMAL_LOCATION);
+        glVertexAttribPointer(
+            NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            reinterpret_cast<void*>(offsetof(Vertex, normal)));
+        // texcoords
+        glEnableVertexAttribArray(TEXCOORDS_LOCATION);
+        glVertexAttribPointer(
+            TEXCOORDS_LOCATION, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+            reinterpret_cast<void*>(offsetof(Vertex, texcoords)));
+        break;
+      }
+      case VertexFormat::Compact: {
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE,
+                              sizeof(CompactVertex),
+                              reinterpret_cast<void*>(0));
+        glEnableVertexAttribArray(OCTAHEDRAL_NORMAL_LOCATION);
+        glVertexAttribPointer(
+            OCTAHEDRAL_NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE,
+            sizeof(CompactVertex),
+            reinterpret_cast<void*>(offsetof(CompactVertex, normal)));
+        glEnableVertexAttribArray(TEXCOORDS_LOCATION);
+        glVertexAttribPointer(
+            TEXCOORDS_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE,
+            sizeof(CompactVertex),
+            reinterpret_cast<void*>(offsetof(CompactVertex, texcoords)));
+        break;
+      }
+      case VertexFormat::CompactQuantized: {
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_UNSIGNED_SHORT, GL_TRUE,
+                              sizeof(QuantizedVertex),
+                              reinterpret_cast<void*>(0));
+        glEnableVertexAttribArray(OCTAHEDRAL_NORMAL_LOCATION);
+        glVertexAttribPointer(
+            OCTAHEDRAL_NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE,
+            sizeof(QuantizedVertex),
+            reinterpret_cast<void*>(offsetof(QuantizedVertex, normal)));
+        glEnableVertexAttribArray(TEXCOORDS_LOCATION);
+        glVertexAttribPointer(
+            TEXCOORDS_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE,
+            sizeof(QuantizedVertex),
+            reinterpret_cast<void*>(offsetof(QuantizedVertex, texcoords)));
+        break;
+      }
+    }
+  }
+
+  // octahedral encoding of unit vector(Cigolle et al. 2014)
+  static void encodeOctahedral(const glm::vec3& n, std::int16_t encoded[2]) {
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    float x = 0.0f;
+    float y = 0.0f;
+    if (l1 > 0.0f) {
+      x = n.x / l1;
+      y = n.y / l1;
+      if (n.z < 0.0f) {
+        const float ox = x;
+        x = (1.0f - std::abs(y)) * (ox >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::abs(ox)) * (y >= 0.0f ? 1.0f : -1.0f);
+      }
+    }
+    encoded[0] = static_cast<std::int16_t>(
+        std::lround(std::clamp(x, -1.0f, 1.0f) * 32767.0f));
+    encoded[1] = static_cast<std::int16_t>(
+        std::lround(std::clamp(y, -1.0f, 1.0f) * 32767.0f));
+  }
+
+  // IEEE 754 binary16 with round to nearest
+  static std::uint16_t toHalf(float value) {
+    std::uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    const std::uint32_t sign = (bits >> 16) & 0x8000;
+    const std::uint32_t biasedExponent = (bits >> 23) & 0xff;
+    std::uint32_t mantissa = bits & 0x7fffff;
+
+    // inf, nan
+    if (biasedExponent == 0xff) {
+      return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+
+    const int exponent = static_cast<int>(biasedExponent) - 127 + 15;
+    // overflow
+    if (exponent >= 31) {
+      return sign | 0x7c00;
+    }
+    // subnormal or zero
+    if (exponent <= 0) {
+      if (exponent < -10) return sign;
+      mantissa |= 0x800000;
+      const int shift = 14 - exponent;
+      std::uint32_t half = mantissa >> shift;
+      if ((mantissa >> (shift - 1)) & 1) half++;
+      return sign | half;
+    }
+
+    std::uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    // rounding may carry into the exponent, which is still correct
+    if (mantissa & 0x1000) half++;
+    return half;
+  }
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <memory>
+#include <optional>
 //
 #include "glad/glad.h"
 //
@@ -117,8 +118,30 @@ int main() {
 
     static char modelFilepath[100] = {"assets/sponza/sponza.obj"};
     ImGui::InputText("Model", modelFilepath, 100);
+    static bool backgroundLoading = true;
+    ImGui::Checkbox("Background Loading", &backgroundLoading);
+    static LoadOptions loadOptions;
+    ImGui::Checkbox("Mesh Cache", &loadOptions.useCache);
+    ImGui::Checkbox("Keep CPU Mesh Data", &loadOptions.keepCPUData);
+    ImGui::Checkbox("Optimize Meshes", &loadOptions.optimizeMeshes);
+    ImGui::Checkbox("Split Meshes", &loadOptions.splitMeshes);
+    ImGui::Checkbox("Deduplicate Textures", &loadOptions.deduplicateTextures);
+    ImGui::Checkbox("Native Loaders", &loadOptions.nativeLoaders);
+    ImGui::Combo("Vertex Format",
+                 reinterpret_cast<int*>(&loadOptions.vertexFormat),
+                 "Float\0Compact\0Compact Quantized\0\0");
+    ImGui::Combo("Texture Resize",
+                 reinterpret_cast<int*>(&loadOptions.textureResize),
+                 "None\0Outliers\0All\0\0");
     if (ImGui::Button("Load Model")) {
-      renderer->loadModel(modelFilepath);
+      if (backgroundLoading) {
+        renderer->loadModelAsync(modelFilepath, loadOptions);
+      } else {
+        renderer->loadModel(modelFilepath, loadOptions);
+      }
+    }
+    if (renderer->isLoadingModel()) {
+      ImGui::ProgressBar(renderer->getLoadingProgress());
     }
 
     static RenderMode renderMode = renderer->getRenderMode();
@@ -146,6 +169,81 @@ int main() {
       renderer->resetCamera();
     }
 
+    static CullingMode cullingMode = renderer->getCullingMode();
+    if (ImGui::Combo("Frustum Culling", reinterpret_cast<int*>(&cullingMode),
+                     "None\0Flat\0BVH\0\0")) {
+      renderer->setCullingMode(cullingMode);
+    }
+
+    static bool occlusionCulling = renderer->getOcclusionCulling();
+    if (ImGui::Checkbox("Occlusion Culling", &occlusionCulling)) {
+      renderer->setOcclusionCulling(occlusionCulling);
+    }
+
+    static bool multiDrawIndirect = renderer->getMultiDrawIndirect();
+    if (ImGui::Checkbox("Multi-Draw Indirect", &multiDrawIndirect)) {
+      renderer->setMultiDrawIndirect(multiDrawIndirect);
+    }
+    if (!MultiDrawIndirect::isSupported()) {
+      ImGui::SameLine();
+      ImGui::Text("(unsupported)");
+    }
+
+    // move a scene graph node in the space of its parent
+    static int node = 0;
+    static float nodeOffset[3] = {0.0f, 0.0f, 0.0f};
+    ImGui::InputInt("Node", &node);
+    ImGui::InputFloat3("Node Offset", nodeOffset);
+    if (ImGui::Button("Move Node") && node >= 0 &&
+        static_cast<std::size_t>(node) < renderer->getNumNodes()) {
+      glm::mat4 local = renderer->getNodeTransform(node);
+      local[3] += glm::vec4(nodeOffset[0], nodeOffset[1], nodeOffset[2], 0.0f);
+      renderer->setNodeTransform(node, local);
+    }
+
+    static std::optional<RayHit> rayHit;
+    if (ImGui::Button("Raycast From Camera")) {
+      rayHit = renderer->raycastFromCamera();
+    }
+    if (rayHit) {
+      ImGui::SameLine();
+      ImGui::Text("mesh %zu at %.3f%s", rayHit->meshIndex, rayHit->distance,
+                  rayHit->exact ? "" : " (bounds)");
+    }
+
+    ImGui::Text("Frame Time: %.3f ms", renderer->getFrameTime());
+    ImGui::Text("Visible Meshes: %zu (culled %zu, occluded %zu)",
+                renderer->getNumVisibleMeshes(),
+                renderer->getNumCulledMeshes(),
+                renderer->getNumOccludedMeshes());
+    ImGui::Text("Visible Instances: %zu of %zu",
+                renderer->getNumVisibleInstances(),
+                renderer->getNumInstances());
+    ImGui::Text("Draw Calls: %zu", renderer->getNumDrawCalls());
+
+    static bool sortDraws = renderer->getSortDraws();
+    if (ImGui::Checkbox("Sort Draws", &sortDraws)) {
+      renderer->setSortDraws(sortDraws);
+    }
+    ImGui::Text("Draw List: %.3f ms (%s)", renderer->getDrawListTime(),
+                sortDraws ? "sorted" : "unsorted");
+    ImGui::Text("GPU Draw Time: %.3f ms", renderer->getDrawTime());
+    ImGui::Text("Camera UBO: %.4f ms (%s)", renderer->getCameraUpdateTime(),
+                renderer->isCameraBufferPersistent() ? "persistent ring"
+                                                     : "glBufferSubData");
+
+    static bool stateCaching = renderer->getStateCaching();
+    if (ImGui::Checkbox("Cache GL State", &stateCaching)) {
+      renderer->setStateCaching(stateCaching);
+    }
+    const ShaderStatistics& shaderStatistics =
+        renderer->getShaderStatistics();
+    ImGui::Text("GL Calls: %zu", shaderStatistics.getTotal());
+    ImGui::Text("  program binds: %zu", shaderStatistics.programBinds);
+    ImGui::Text("  location queries: %zu", shaderStatistics.locationQueries);
+    ImGui::Text("  uniform updates: %zu", shaderStatistics.uniformUpdates);
+    ImGui::Text("  texture binds: %zu", shaderStatistics.textureBinds);
+
     ImGui::End();
 
     // handle input